@@ -0,0 +1,40 @@
+// Counting replacement for the global operator new/delete
+
+#include <cstdlib>
+#include <new>
+#include "alloc_count.h"
+
+static thread_local unsigned long long num_heap_allocations = 0;
+
+unsigned long long ThreadHeapAllocations () {
+  return num_heap_allocations;
+}
+
+void* operator new (std::size_t size) {
+  num_heap_allocations++;
+  void* ptr = malloc(size == 0 ? 1 : size);
+  if (ptr == NULL) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+void* operator new[] (std::size_t size) {
+  return operator new(size);
+}
+
+void operator delete (void* ptr) noexcept {
+  free(ptr);
+}
+
+void operator delete[] (void* ptr) noexcept {
+  free(ptr);
+}
+
+void operator delete (void* ptr, std::size_t) noexcept {
+  free(ptr);
+}
+
+void operator delete[] (void* ptr, std::size_t) noexcept {
+  free(ptr);
+}
@@ -0,0 +1,10 @@
+#ifndef _alloc_count_h
+#define _alloc_count_h
+
+// Returns the number of heap allocations the calling thread has made through
+// operator new so far. Linking alloc_count.o replaces the global operator
+// new/delete with thin malloc/free wrappers that keep this count, so the
+// baseline can show which phases allocate.
+unsigned long long ThreadHeapAllocations ();
+
+#endif
@@ -0,0 +1,239 @@
+// Provides the wall-clock timers and reports behind --bench
+
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include "bench.h"
+
+static const char* kPhaseNames[NUM_BENCH_PHASES] = {
+  "load", "split", "lookup", "fetch", "stitch", "output"
+};
+
+const char* BenchPhaseName (int phase) {
+  return kPhaseNames[phase];
+}
+
+double WallSeconds () {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Nanoseconds below which every value has its own latency bucket
+#define LATENCY_LINEAR_NS (2ULL << LATENCY_SUB_BUCKET_BITS)
+
+/* Returns the latency bucket of a sample in nanoseconds.
+ */
+static unsigned int LatencyBucket (unsigned long long ns) {
+  if (ns < LATENCY_LINEAR_NS) {
+    return (unsigned int) ns;
+  }
+  if (ns >= (1ULL << LATENCY_MAX_EXPONENT)) {
+    return NUM_LATENCY_BUCKETS - 1;
+  }
+  // The top LATENCY_SUB_BUCKET_BITS + 1 bits of ns, leading one included,
+  // pick the bucket within its power of two
+  unsigned int exponent = 63 - __builtin_clzll(ns);
+  unsigned int shift = exponent - LATENCY_SUB_BUCKET_BITS;
+  return (shift << LATENCY_SUB_BUCKET_BITS) + (unsigned int) (ns >> shift);
+}
+
+/* Returns the middle of a latency bucket in nanoseconds.
+ */
+static double LatencyBucketMiddle (unsigned int bucket) {
+  if (bucket < LATENCY_LINEAR_NS) {
+    return bucket;
+  }
+  unsigned int shift = (bucket >> LATENCY_SUB_BUCKET_BITS) - 1;
+  unsigned long long width = 1ULL << shift;
+  return (bucket - (shift << LATENCY_SUB_BUCKET_BITS)) * width + width / 2.0;
+}
+
+void ClearLatencies (latency_histogram* histogram) {
+  memset(histogram, 0, sizeof(*histogram));
+}
+
+void AddLatencies (latency_histogram* histogram, const float* samples, size_t num_samples) {
+  for (size_t i = 0; i < num_samples; i++) {
+    histogram->count[LatencyBucket((unsigned long long) (samples[i] * 1e3))]++;
+    histogram->max_us = std::max(histogram->max_us, samples[i]);
+  }
+  histogram->num_samples += num_samples;
+}
+
+/* Returns the nearest-rank percentile p (0-100) of the histogram in
+ * seconds, never more than the largest sample.
+ */
+static double Percentile (const latency_histogram* histogram, double p) {
+  if (histogram->num_samples == 0) {
+    return 0;
+  }
+  unsigned long long rank = (unsigned long long) (p / 100.0 * histogram->num_samples + 0.999999);
+  if (rank == 0) {
+    rank = 1;
+  }
+  unsigned long long seen = 0;
+  unsigned int bucket = 0;
+  for (; bucket < NUM_LATENCY_BUCKETS - 1; bucket++) {
+    seen += histogram->count[bucket];
+    if (seen >= rank) {
+      break;
+    }
+  }
+  return std::min(LatencyBucketMiddle(bucket) * 1e-9, histogram->max_us * 1e-6);
+}
+
+void SummarizeLatencies (const latency_histogram* histogram, bench_trial* trial) {
+  trial->latency_p50 = Percentile(histogram, 50);
+  trial->latency_p99 = Percentile(histogram, 99);
+  trial->latency_p999 = Percentile(histogram, 99.9);
+  trial->latency_max = histogram->max_us * 1e-6;
+}
+
+/* Returns the interval table traffic of num_lookups random lookups over the
+ * given time in bytes per second. Each lookup reads a start and end that
+ * almost always share one cache line.
+ */
+static double LookupBandwidth (unsigned long long num_lookups, double seconds) {
+  return (seconds > 0) ? num_lookups * 64.0 / seconds : 0;
+}
+
+void PrintBenchSummary (const bench_report* report) {
+  std::vector<double> totals;
+  for (const bench_trial& trial : report->trials) {
+    if (!trial.warmup) {
+      totals.push_back(trial.total_seconds);
+    }
+  }
+  if (totals.empty()) {
+    return;
+  }
+  std::sort(totals.begin(), totals.end());
+  double median = totals[totals.size() / 2];
+  std::cout << "Table load (s):\t" << report->table_load_seconds << std::endl;
+  std::cout << "Trials:\t" << totals.size() << " (min " << totals.front() << " s, median " << median
+            << " s, max " << totals.back() << " s)" << std::endl;
+  std::cout << "Queries per second (median):\t" << report->num_queries / median << std::endl;
+  std::cout << "Table pages:\tinterval " << report->interval_pages << ", position " << report->position_pages
+            << std::endl;
+  std::cout << "Table size (MB):\tinterval " << report->interval_bytes / 1e6 << ", position "
+            << report->position_bytes / 1e6 << " (every " << report->position_step << " offsets)" << std::endl;
+  std::vector<double> speedups;
+  for (const bench_trial& trial : report->trials) {
+    if (!trial.warmup && trial.small_page_lookup_seconds > 0 && trial.phase_seconds[PHASE_LOOKUP] > 0) {
+      speedups.push_back(trial.small_page_lookup_seconds / trial.phase_seconds[PHASE_LOOKUP]);
+    }
+  }
+  if (!speedups.empty()) {
+    std::sort(speedups.begin(), speedups.end());
+    std::cout << "Lookup speedup over default pages (median):\t" << speedups[speedups.size() / 2] << std::endl;
+  }
+  for (size_t t = 0; t < report->trials.size(); t++) {
+    const bench_trial& trial = report->trials[t];
+    std::cout << (trial.warmup ? "Warm-up " : "Trial ") << t << ":\t" << trial.total_seconds << " s";
+    for (int p = 0; p < NUM_BENCH_PHASES; p++) {
+      std::cout << "  " << BenchPhaseName(p) << " " << trial.phase_seconds[p];
+    }
+    std::cout << std::endl;
+    std::cout << "\tStitch latency (us): p50 " << trial.latency_p50 * 1e6 << "  p99 " << trial.latency_p99 * 1e6
+              << "  p99.9 " << trial.latency_p999 * 1e6 << "  max " << trial.latency_max * 1e6 << std::endl;
+    if (trial.cache_lookups > 0) {
+      std::cout << "\tResult cache: " << trial.cache_hits << " hits out of " << trial.cache_lookups << " ("
+                << 100.0 * trial.cache_hits / trial.cache_lookups << "%)" << std::endl;
+    }
+    for (size_t n = 0; n < trial.node_lookups.size(); n++) {
+      std::cout << "\tNode " << report->numa_nodes[n] << ": " << trial.node_lookups[n] << " lookups, "
+                << LookupBandwidth(trial.node_lookups[n], trial.phase_seconds[PHASE_LOOKUP]) / 1e9 << " GB/s"
+                << std::endl;
+    }
+  }
+}
+
+void WriteBenchJson (const char* filename, const bench_report* report, const options* opts) {
+  std::ofstream file;
+  if (filename != NULL) {
+    file.open(filename);
+    if (!file.is_open()) {
+      std::cerr << "Could not open " << filename << std::endl;
+      exit(1);
+    }
+  }
+  std::ostream& out = (filename != NULL) ? file : std::cout;
+  out.precision(9);
+  out << "{\n";
+  out << "  \"num_queries\": " << report->num_queries << ",\n";
+  out << "  \"query_length\": " << report->query_length << ",\n";
+  out << "  \"subread_length\": " << report->subread_length << ",\n";
+  out << "  \"options\": {\"threads\": " << opts->num_threads << ", \"batch\": " << opts->batch_size
+      << ", \"mmap\": " << (opts->use_mmap ? "true" : "false")
+      << ", \"hugepages\": \"" << TablePagesName(opts->huge_pages) << "\""
+      << ", \"numa\": \"" << NumaPolicyName(opts->numa) << "\""
+      << ", \"index\": \"" << SeedIndexName(opts->index) << "\""
+      << ", \"positions\": \"" << PositionFormatName(opts->positions) << "\""
+      << ", \"merge\": \"" << MergeBackendName(opts->merge.backend) << "\""
+      << ", \"gallop_ratio\": " << opts->merge.gallop_ratio
+      << ", \"plan\": " << (opts->plan ? "true" : "false")
+      << ", \"kway\": " << (opts->kway ? "true" : "false")
+      << ", \"sort_join\": " << (opts->sort_join ? "true" : "false")
+      << ", \"group\": " << opts->prefetch_group << ", \"chunk\": " << opts->chunk_size
+      << ", \"output\": \"" << (opts->output_format == RESULTS_BINARY ? "binary" : "text") << "\""
+      << ", \"verify\": " << (opts->verify_ref != NULL ? "true" : "false")
+      << ", \"verify_seeds\": " << opts->verify_seeds
+      << ", \"both_strands\": " << (opts->both_strands ? "true" : "false")
+      << ", \"cache_entries\": " << opts->cache_entries
+      << ", \"perf\": " << (opts->perf ? "true" : "false") << "},\n";
+  out << "  \"table_load_seconds\": " << report->table_load_seconds << ",\n";
+  out << "  \"table_pages\": {\"interval\": \"" << report->interval_pages << "\", \"position\": \""
+      << report->position_pages << "\"},\n";
+  out << "  \"table_bytes\": {\"interval\": " << report->interval_bytes << ", \"position\": "
+      << report->position_bytes << ", \"position_step\": " << report->position_step << "},\n";
+  bool counted = false;
+  for (int e = 0; e < NUM_PERF_EVENTS; e++) {
+    counted = counted || report->counters[e];
+  }
+  out << "  \"trials\": [";
+  for (size_t t = 0; t < report->trials.size(); t++) {
+    const bench_trial& trial = report->trials[t];
+    out << (t == 0 ? "\n" : ",\n");
+    out << "    {\"warmup\": " << (trial.warmup ? "true" : "false") << ", \"total_seconds\": " << trial.total_seconds
+        << ", \"phases\": {";
+    for (int p = 0; p < NUM_BENCH_PHASES; p++) {
+      out << (p == 0 ? "" : ", ") << "\"" << BenchPhaseName(p) << "\": " << trial.phase_seconds[p];
+    }
+    out << "}, \"stitch_latency_seconds\": {\"p50\": " << trial.latency_p50 << ", \"p99\": " << trial.latency_p99
+        << ", \"p99.9\": " << trial.latency_p999 << ", \"max\": " << trial.latency_max << "}";
+    if (trial.cache_lookups > 0) {
+      out << ", \"result_cache\": {\"lookups\": " << trial.cache_lookups << ", \"hits\": " << trial.cache_hits << "}";
+    }
+    if (!trial.node_lookups.empty()) {
+      out << ", \"numa_nodes\": [";
+      for (size_t n = 0; n < trial.node_lookups.size(); n++) {
+        out << (n == 0 ? "" : ", ") << "{\"node\": " << report->numa_nodes[n] << ", \"lookups\": "
+            << trial.node_lookups[n] << ", \"lookup_bytes_per_second\": "
+            << LookupBandwidth(trial.node_lookups[n], trial.phase_seconds[PHASE_LOOKUP]) << "}";
+      }
+      out << "]";
+    }
+    if (trial.small_page_lookup_seconds > 0) {
+      out << ", \"default_pages_lookup_seconds\": " << trial.small_page_lookup_seconds;
+    }
+    if (counted) {
+      out << ", \"counters\": {";
+      for (int p = 0; p < NUM_BENCH_PHASES; p++) {
+        out << (p == 0 ? "" : ", ") << "\"" << BenchPhaseName(p) << "\": {";
+        bool first = true;
+        for (int e = 0; e < NUM_PERF_EVENTS; e++) {
+          if (report->counters[e]) {
+            out << (first ? "" : ", ") << "\"" << PerfEventName(e) << "\": " << trial.counters[p].count[e];
+            first = false;
+          }
+        }
+        out << "}";
+      }
+      out << "}";
+    }
+    out << "}";
+  }
+  out << "\n  ]\n}\n";
+}
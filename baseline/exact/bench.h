@@ -0,0 +1,96 @@
+#ifndef _bench_h
+#define _bench_h
+
+#include <vector>
+#include "options.h"
+#include "perf_counters.h"
+
+// Phases of one pass over the query file timed by --bench. LOAD is reading
+// the queries (tables are loaded once, before any trial). FETCH is reading
+// position lists out of the table ahead of merging them: each query's
+// leading list, every later list that is decoded before it is merged
+// (packed, Elias-Fano), a sampled table's candidates, and setting up the
+// k-way list heads. STITCH is everything else of stitching a query: the
+// cache probe, intersecting (which reads raw and varint lists, galloped
+// Elias-Fano lists and k-way lists in place) and verifying.
+enum bench_phase {
+  PHASE_LOAD,
+  PHASE_SPLIT,
+  PHASE_LOOKUP,
+  PHASE_FETCH,
+  PHASE_STITCH,
+  PHASE_OUTPUT,
+  NUM_BENCH_PHASES
+};
+
+// Returns the name of a phase as it appears in the summary and JSON.
+const char* BenchPhaseName (int phase);
+
+// Returns a monotonic wall-clock time in seconds.
+double WallSeconds ();
+
+// Wall-clock results of one pass over the query file.
+struct bench_trial {
+  bool warmup;
+  double total_seconds;
+  double phase_seconds[NUM_BENCH_PHASES];
+  // Per-query stitch latency percentiles (s): fetch plus stitch of the
+  // query, from its cache probe until its hits are ready. Lookup and
+  // output run a batch at a time and are not included.
+  double latency_p50;
+  double latency_p99;
+  double latency_p999;
+  double latency_max;
+  perf_sample counters[NUM_BENCH_PHASES]; // --perf: events per phase
+  double small_page_lookup_seconds;   // --hugepages: lookup against a default page copy
+  std::vector<unsigned long long> node_lookups; // --numa: interval lookups per node
+  unsigned long long cache_lookups;   // Result cache queries and duplicates served
+  unsigned long long cache_hits;
+};
+
+// Per-query latencies of one trial, binned so that --bench keeps the same
+// memory however many chunks stream through. Below 64 ns every nanosecond
+// has a bucket; above, each power of two is split into 32 buckets, so a
+// percentile is within about 3% of the exact sample. Latencies past 2^40 ns
+// (about 18 minutes) share the last bucket; the maximum is kept exactly.
+#define LATENCY_SUB_BUCKET_BITS 5
+#define LATENCY_MAX_EXPONENT 40
+#define NUM_LATENCY_BUCKETS ((LATENCY_MAX_EXPONENT - LATENCY_SUB_BUCKET_BITS + 1) << LATENCY_SUB_BUCKET_BITS)
+struct latency_histogram {
+  unsigned long long count[NUM_LATENCY_BUCKETS];
+  unsigned long long num_samples;
+  float max_us;
+};
+
+void ClearLatencies (latency_histogram* histogram);
+
+// Adds num_samples per-query latencies, given in microseconds.
+void AddLatencies (latency_histogram* histogram, const float* samples, size_t num_samples);
+
+// Fills the latency fields of trial from the histogram.
+void SummarizeLatencies (const latency_histogram* histogram, bench_trial* trial);
+
+// Everything reported by --bench.
+struct bench_report {
+  unsigned int num_queries;
+  unsigned int query_length;
+  unsigned int subread_length;
+  double table_load_seconds;
+  const char* interval_pages;      // Page backing of each table (TablePagesName)
+  const char* position_pages;
+  size_t interval_bytes;           // Size of each table in memory, in whole
+  size_t position_bytes;           // words except for a varint stream's exact length
+  unsigned int position_step;      // Reference offsets per position table entry (1 = all)
+  std::vector<int> numa_nodes;     // --numa: node ids, in the order of node_lookups
+  bool counters[NUM_PERF_EVENTS];  // --perf: events that could be counted
+  std::vector<bench_trial> trials;
+};
+
+// Prints a human-readable summary of the measured (non warm-up) trials.
+void PrintBenchSummary (const bench_report* report);
+
+// Writes the report and the options it was measured under as JSON to
+// filename, or to standard output if filename is NULL.
+void WriteBenchJson (const char* filename, const bench_report* report, const options* opts);
+
+#endif
@@ -0,0 +1,75 @@
+// Reads contig tables and maps joined reference positions to contigs
+
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
+#include <algorithm>
+#include <stdint.h>
+#include "contigs.h"
+
+void ReadContigTable (char* filename, contig_table* contigs) {
+  std::ifstream contig_file(filename, std::ios::binary);
+  if (!contig_file.is_open()) {
+    std::cerr << "Could not open " << filename << std::endl;
+    exit(1);
+  }
+  unsigned int num_contigs = 0;
+  contig_file.read((char *)(&num_contigs), sizeof(unsigned int));
+  if (!contig_file || num_contigs == 0) {
+    std::cerr << "Invalid contig table " << filename << std::endl;
+    exit(1);
+  }
+  contigs->num_contigs = num_contigs;
+  contigs->starts = new unsigned int[num_contigs];
+  contigs->lengths = new unsigned int[num_contigs];
+  contigs->names = new char*[num_contigs]();
+  uint64_t previous_end = 0;
+  for (unsigned int c = 0; c < num_contigs; c++) {
+    unsigned int name_length = 0;
+    contig_file.read((char *)(&contigs->starts[c]), sizeof(unsigned int));
+    contig_file.read((char *)(&contigs->lengths[c]), sizeof(unsigned int));
+    contig_file.read((char *)(&name_length), sizeof(unsigned int));
+    uint64_t end = (uint64_t) contigs->starts[c] + contigs->lengths[c];
+    if (!contig_file || name_length > MAX_CONTIG_NAME || contigs->starts[c] < previous_end || end > UINT32_MAX) {
+      std::cerr << "Invalid contig table " << filename << std::endl;
+      exit(1);
+    }
+    contigs->names[c] = new char[name_length + 1];
+    contig_file.read(contigs->names[c], name_length);
+    contigs->names[c][name_length] = '\0';
+    previous_end = end;
+  }
+  if (!contig_file) {
+    std::cerr << "Truncated contig table " << filename << std::endl;
+    exit(1);
+  }
+}
+
+void FreeContigTable (contig_table* contigs) {
+  for (unsigned int c = 0; c < contigs->num_contigs; c++) {
+    delete[] contigs->names[c];
+  }
+  delete[] contigs->names;
+  delete[] contigs->starts;
+  delete[] contigs->lengths;
+  contigs->names = NULL;
+  contigs->starts = NULL;
+  contigs->lengths = NULL;
+  contigs->num_contigs = 0;
+}
+
+bool LocateHit (const contig_table* contigs, unsigned int position, unsigned int span, unsigned int* contig,
+                unsigned int* offset) {
+  // Last contig starting at or before position
+  const unsigned int* next = std::upper_bound(contigs->starts, contigs->starts + contigs->num_contigs, position);
+  if (next == contigs->starts) {
+    return false;
+  }
+  unsigned int c = (unsigned int) (next - contigs->starts) - 1;
+  if ((uint64_t) position + span > (uint64_t) contigs->starts[c] + contigs->lengths[c]) {
+    return false;
+  }
+  *contig = c;
+  *offset = position - contigs->starts[c];
+  return true;
+}
@@ -0,0 +1,38 @@
+#ifndef _contigs_h
+#define _contigs_h
+
+// Contig table written by join_ref_seqs next to a joined reference. The
+// joined reference is every contig (chromosome) packed back to back into one
+// 2-bit reference, indexed by gen_tables like any other, so a hit position
+// is an offset into the joined reference. The contig table maps it back to
+// a contig and an offset within it. File layout, little-endian:
+//   Number of contigs (4 bytes)
+//   Per contig: start in the joined reference (4 bytes), length (4 bytes),
+//               name length (4 bytes), name (not NUL terminated)
+// Contigs are stored in reference order and do not overlap.
+//
+// Positions stay 32-bit: a joined reference holds at most 2^32 - 1 bases
+// (one 4 Gbp segment), which takes a whole human genome in one index.
+
+// Longest contig name accepted, well beyond any FASTA header in use.
+// join_ref_seqs refuses to write a longer one.
+#define MAX_CONTIG_NAME 4096
+
+struct contig_table {
+  unsigned int  num_contigs;
+  unsigned int* starts;
+  unsigned int* lengths;
+  char**        names;
+};
+
+// Reads a contig table. Exits with a message if it is malformed.
+void ReadContigTable (char* filename, contig_table* contigs);
+void FreeContigTable (contig_table* contigs);
+
+// Finds the contig holding a hit that covers span bases from position. Sets
+// *contig and *offset and returns true, or returns false if the hit runs
+// off its contig, i.e. matched across the junction of two contigs.
+bool LocateHit (const contig_table* contigs, unsigned int position, unsigned int span, unsigned int* contig,
+                unsigned int* offset);
+
+#endif
@@ -3,22 +3,33 @@
 
 #include <stdint.h>
 
+// The lists below are stored flat, one contiguous buffer per field, so the
+// split and lookup passes stream through memory instead of chasing a
+// pointer (and paying for an allocation) per query or per subread.
+
+// Query i occupies bytes_per_query bytes starting at ptr[i*bytes_per_query].
 struct query_list {
   int num_queries;
   int query_length;
-  unsigned char** ptr;
+  int bytes_per_query;
+  unsigned char* ptr;
 };
 
+// Subread j of query i is ptr[i*num_subreads_per_query + j]. Subreads are
+// 64 bits wide so the hash index can take seeds of up to 32 nucleotides.
 struct subread_list {
   int num_queries;
   int num_subreads_per_query;
-  uint32_t** ptr;
+  uint64_t* ptr;
 };
 
+// The position table interval of subread j of query i is
+// [start[i*num_subreads_per_query + j], end[i*num_subreads_per_query + j]).
 struct interval_list {
   int num_queries;
   int num_subreads_per_query;
-  uint32_t*** ptr;
+  uint32_t* start;
+  uint32_t* end;
 };
 
 #endif
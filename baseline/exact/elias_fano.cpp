@@ -0,0 +1,266 @@
+// Reads and intersects Elias-Fano position tables for --positions elias-fano
+
+#include <iostream>
+#include <cstdlib>
+#include <string.h>
+#include "elias_fano.h"
+
+/* Returns the index of the r-th (from 0) set bit of word, a byte at a time.
+ */
+static inline unsigned int SelectInWord (uint64_t word, unsigned int r) {
+  unsigned int shift = 0;
+  unsigned int count = __builtin_popcountll(word & 0xFF);
+  while (r >= count) {
+    r -= count;
+    shift += 8;
+    count = __builtin_popcountll((word >> shift) & 0xFF);
+  }
+  unsigned int byte = (word >> shift) & 0xFF;
+  for (; r > 0; r--) {
+    byte &= byte - 1;
+  }
+  return shift + __builtin_ctz(byte);
+}
+
+/* Returns the bit position of the n-th (from 1) one at or after pos of the
+ * high bitvector, or of the n-th zero if flip is all ones. It must exist.
+ */
+static inline uint64_t ScanSelect (const uint64_t* high, uint64_t pos, uint64_t n, uint64_t flip) {
+  uint64_t w = pos >> 6;
+  uint64_t bits = (high[w] ^ flip) & (~0ULL << (pos & 63));
+  unsigned int count = __builtin_popcountll(bits);
+  while (n > count) {
+    n -= count;
+    bits = high[++w] ^ flip;
+    count = __builtin_popcountll(bits);
+  }
+  return (w << 6) + SelectInWord(bits, n - 1);
+}
+
+static inline uint64_t NextOne (const uint64_t* high, uint64_t pos) {
+  uint64_t w = pos >> 6;
+  uint64_t bits = high[w] & (~0ULL << (pos & 63));
+  while (bits == 0) {
+    bits = high[++w];
+  }
+  return (w << 6) + __builtin_ctzll(bits);
+}
+
+/* Returns the bit position of the r-th (from 0) one, or zero if zeros is
+ * set, of the high bitvector, scanning on from the sample at or before it.
+ */
+static uint64_t Select (const elias_fano* ef, uint64_t r, bool zeros) {
+  if (zeros) {
+    return ScanSelect(ef->high, ef->zero_samples[r >> EF_ZERO_SAMPLE_SHIFT], (r & (EF_ZERO_SAMPLE - 1)) + 1, ~0ULL);
+  }
+  return ScanSelect(ef->high, ef->one_samples[r >> EF_ONE_SAMPLE_SHIFT], (r & (EF_ONE_SAMPLE - 1)) + 1, 0);
+}
+
+static inline uint64_t LowBits (const elias_fano* ef, uint64_t k) {
+  uint64_t bit = k * ef->low_bits;
+  uint64_t word;
+  memcpy(&word, ef->low + (bit >> 3), sizeof(word));
+  return (word >> (bit & 7)) & ((1ULL << ef->low_bits) - 1);
+}
+
+/* Returns the value of entry j * EF_ONE_SAMPLE.
+ */
+static inline uint64_t SampleValue (const elias_fano* ef, uint64_t j) {
+  uint64_t k = j << EF_ONE_SAMPLE_SHIFT;
+  return ((ef->one_samples[j] - k) << ef->low_bits) | LowBits(ef, k);
+}
+
+void EliasFanoView (char* filename, const table* position_table, elias_fano* ef) {
+  elias_fano_header header;
+  if (position_table->length < EF_HEADER_WORDS) {
+    std::cerr << "Truncated position table " << filename << std::endl;
+    exit(1);
+  }
+  memcpy(&header, position_table->ptr, sizeof(header));
+  size_t num_words = EF_HEADER_WORDS + 2 * ((size_t) header.num_low_words + header.num_high_words +
+                                            header.num_one_samples + header.num_zero_samples);
+  if (num_words > position_table->length || header.low_bits > EF_MAX_LOW_BITS || header.position_bits > 32 ||
+      header.num_high_words == 0 || header.num_one_samples == 0 || header.num_zero_samples == 0) {
+    std::cerr << "Invalid Elias-Fano position table " << filename << std::endl;
+    exit(1);
+  }
+  const uint64_t* sections = (const uint64_t*) (position_table->ptr + EF_HEADER_WORDS);
+  ef->low = (const unsigned char*) sections;
+  ef->high = sections + header.num_low_words;
+  ef->one_samples = ef->high + header.num_high_words;
+  ef->zero_samples = ef->one_samples + header.num_one_samples;
+  ef->num_positions = header.num_positions;
+  ef->low_bits = header.low_bits;
+  ef->position_bits = header.position_bits;
+  ef->max_bucket = 0;
+  if (ef->num_positions > 0) {
+    ef->max_bucket = Select(ef, ef->num_positions - 1, false) - (ef->num_positions - 1);
+  }
+}
+
+unsigned int EliasFanoPosition (const elias_fano* ef, uint32_t k) {
+  uint64_t value = ((Select(ef, k, false) - k) << ef->low_bits) | LowBits(ef, k);
+  return (unsigned int) (value & ((1ULL << ef->position_bits) - 1));
+}
+
+// Forward-only read position within one list
+struct ef_cursor {
+  const elias_fano* ef;
+  uint32_t index;              // current entry, end once exhausted
+  uint32_t end;
+  uint64_t high_pos;           // bit of the current entry in the high bitvector
+  uint64_t value;              // value of the current entry
+  unsigned int decoded;        // entries whose value was computed
+};
+
+static inline void LoadValue (ef_cursor* c) {
+  c->value = ((c->high_pos - c->index) << c->ef->low_bits) | LowBits(c->ef, c->index);
+  c->decoded++;
+}
+
+/* Points c at entry first of seed's list [first, last). Returns false if
+ * the list is empty.
+ */
+static bool StartCursor (const elias_fano* ef, uint64_t seed, uint32_t first, uint32_t last, ef_cursor* c) {
+  c->ef = ef;
+  c->index = first;
+  c->end = last;
+  c->decoded = 0;
+  if (first >= last) {
+    return false;
+  }
+  c->high_pos = NextOne(ef->high, EliasFanoListBit(ef, seed, first));
+  LoadValue(c);
+  return true;
+}
+
+/* Moves c to the next entry. Returns false at the end of the list.
+ */
+static inline bool Advance (ef_cursor* c) {
+  if (++c->index >= c->end) {
+    return false;
+  }
+  c->high_pos = NextOne(c->ef->high, c->high_pos + 1);
+  LoadValue(c);
+  return true;
+}
+
+/* Moves c forward to the first entry with value >= x. Returns false if the
+ * list has none. Entries in between are skipped without being decoded in
+ * two ways. When x lies in a later bucket b than the current entry, c jumps
+ * to bucket b: its entries follow the b-th zero of the high bitvector,
+ * found by scanning on from the current entry when it is near and through
+ * the zero samples otherwise, and the ones before that zero count the
+ * entries skipped. Then, if the next entry sample in the list is still
+ * below x, c gallops over the samples to the last one below x.
+ */
+static bool NextGEQ (ef_cursor* c, uint64_t x) {
+  if (c->index >= c->end) {
+    return false;
+  }
+  if (c->value >= x) {
+    return true;
+  }
+  const elias_fano* ef = c->ef;
+  uint64_t bucket = x >> ef->low_bits;
+  uint64_t current_bucket = c->high_pos - c->index;
+  if (bucket > current_bucket) {
+    if (bucket > ef->max_bucket) {
+      c->index = c->end;
+      return false;
+    }
+    uint64_t bucket_pos;
+    if (bucket - current_bucket > 2 * EF_ZERO_SAMPLE) {
+      bucket_pos = Select(ef, bucket - 1, true) + 1;
+    } else {
+      bucket_pos = ScanSelect(ef->high, c->high_pos, bucket - current_bucket, ~0ULL) + 1;
+    }
+    uint64_t index = bucket_pos - bucket;
+    if (index >= c->end) {
+      c->index = c->end;
+      return false;
+    }
+    c->index = (uint32_t) index;
+    c->high_pos = NextOne(ef->high, bucket_pos);
+    LoadValue(c);
+  }
+  uint64_t sample = (c->index >> EF_ONE_SAMPLE_SHIFT) + 1;
+  if (c->value < x && (sample << EF_ONE_SAMPLE_SHIFT) < c->end && SampleValue(ef, sample) < x) {
+    // Exponential then binary search for the last sample below x
+    uint64_t num_samples = ((uint64_t) c->end - 1) >> EF_ONE_SAMPLE_SHIFT;  // last sample in the list
+    uint64_t low = sample;
+    uint64_t step = 1;
+    while (low + step <= num_samples && SampleValue(ef, low + step) < x) {
+      low += step;
+      step *= 2;
+    }
+    uint64_t high = (low + step <= num_samples) ? low + step : num_samples + 1;
+    while (high - low > 1) {
+      uint64_t mid = low + (high - low) / 2;
+      if (SampleValue(ef, mid) < x) {
+        low = mid;
+      } else {
+        high = mid;
+      }
+    }
+    c->index = (uint32_t) (low << EF_ONE_SAMPLE_SHIFT);
+    c->high_pos = ef->one_samples[low];
+    LoadValue(c);
+  }
+  while (c->value < x) {
+    if (!Advance(c)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+unsigned int DecodeEliasFanoList (const elias_fano* ef, uint64_t seed, uint32_t first, uint32_t last,
+                                  unsigned int offset, unsigned int* out, unsigned int* positions_read) {
+  ef_cursor c;
+  unsigned int count = 0;
+  if (StartCursor(ef, seed, first, last, &c)) {
+    uint64_t base = seed << ef->position_bits;
+    if (NextGEQ(&c, base + offset)) {
+      // Walk the ones of the high bitvector a word at a time from here on
+      out[count++] = (unsigned int) (c.value - base) - offset;
+      uint64_t w = c.high_pos >> 6;
+      uint64_t bits = ef->high[w] & (~0ULL << (c.high_pos & 63));
+      bits &= bits - 1;
+      base += offset;
+      for (uint32_t k = c.index + 1; k < last; k++) {
+        while (bits == 0) {
+          bits = ef->high[++w];
+        }
+        uint64_t high_pos = (w << 6) + __builtin_ctzll(bits);
+        bits &= bits - 1;
+        out[count++] = (unsigned int) ((((high_pos - k) << ef->low_bits) | LowBits(ef, k)) - base);
+      }
+      c.decoded += last - c.index - 1;
+    }
+  }
+  *positions_read = c.decoded;
+  return count;
+}
+
+unsigned int IntersectEliasFanoList (const unsigned int* list1, unsigned int length1, const elias_fano* ef,
+                                     uint64_t seed, uint32_t first, uint32_t last, unsigned int offset,
+                                     unsigned int* result, unsigned int* positions_read) {
+  ef_cursor c;
+  unsigned int count = 0;
+  if (length1 > 0 && StartCursor(ef, seed, first, last, &c)) {
+    uint64_t position_mask = (1ULL << ef->position_bits) - 1;
+    uint64_t base = seed << ef->position_bits;
+    for (unsigned int k = 0; k < length1; k++) {
+      uint64_t target = (uint64_t) list1[k] + offset;
+      if (target > position_mask || !NextGEQ(&c, base + target)) {
+        break;
+      }
+      if (c.value == base + target) {
+        result[count++] = list1[k];
+      }
+    }
+  }
+  *positions_read = (length1 > 0) ? c.decoded : 0;
+  return count;
+}
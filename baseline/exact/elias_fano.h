@@ -0,0 +1,95 @@
+#ifndef _elias_fano_h
+#define _elias_fano_h
+
+#include <stdint.h>
+#include "table_io.h"
+
+// Position tables written by gen_tables --elias-fano, read with --positions
+// elias-fano. The whole table is one Elias-Fano coded increasing sequence
+// of the values v = seed << P | position, P being the bits of the largest
+// position, so entry k is still entry k of the raw table and the interval
+// table is unchanged. Each v is split into its low_bits low bits, stored
+// packed like a --packed table, and its high part h, stored in unary: entry
+// k sets bit h + k of the high bitvector. The bit of every
+// EF_ONE_SAMPLE-th one (entry) and EF_ZERO_SAMPLE-th zero is sampled, so any
+// entry is reached with one sample and a few words of popcount (select1),
+// and the first entry of any bucket h likewise (select0).
+//
+// The low bits are about log2(4^k) wide, so on a reference shorter than
+// 4^k a seed's whole list falls in one or two buckets and bucket skipping
+// cannot help within it. The entry samples double as skip pointers: their
+// values increase, so NextGEQ gallops over the samples inside a long list
+// and then scans at most EF_ONE_SAMPLE entries.
+//
+// A list is normally entered from its seed, without select: every earlier
+// entry has a smaller high part, so the first one at or after
+// EliasFanoListBit() is the list's first entry.
+//
+// Layout, after the reference and seed length header, in table words:
+//   EF_HEADER_WORDS words: the elias_fano_header below
+//   low bits           (num_low_words 64-bit words, 8 zero bytes of slack)
+//   high bitvector     (num_high_words 64-bit words)
+//   one samples        (num_one_samples 64-bit bit positions)
+//   zero samples       (num_zero_samples 64-bit bit positions)
+#define EF_ONE_SAMPLE_SHIFT 6
+#define EF_ONE_SAMPLE (1U << EF_ONE_SAMPLE_SHIFT)
+#define EF_ZERO_SAMPLE_SHIFT 8
+#define EF_ZERO_SAMPLE (1U << EF_ZERO_SAMPLE_SHIFT)
+#define EF_HEADER_WORDS 8
+#define EF_MAX_LOW_BITS 56
+
+struct elias_fano_header {
+  uint32_t num_positions;
+  uint32_t low_bits;
+  uint32_t position_bits;     // P
+  uint32_t num_low_words;
+  uint32_t num_high_words;
+  uint32_t num_one_samples;
+  uint32_t num_zero_samples;
+  uint32_t reserved;
+};
+
+// Parsed view of an Elias-Fano position table
+struct elias_fano {
+  const unsigned char* low;
+  const uint64_t* high;
+  const uint64_t* one_samples;
+  const uint64_t* zero_samples;
+  unsigned int num_positions;
+  unsigned int low_bits;
+  unsigned int position_bits;
+  uint64_t max_bucket;        // high part of the last value
+};
+
+// Sets up ef to read the table loaded by Read/MapEliasFanoPositionTable().
+// Exits with a message if the sections do not fit the table.
+void EliasFanoView (char* filename, const table* position_table, elias_fano* ef);
+
+// Returns the bit of the high bitvector from which the list of seed, whose
+// first entry is first, is found by scanning for the next one.
+inline uint64_t EliasFanoListBit (const elias_fano* ef, uint64_t seed, uint32_t first) {
+  return ((seed << ef->position_bits) >> ef->low_bits) + first;
+}
+
+// Returns the position stored at entry k.
+unsigned int EliasFanoPosition (const elias_fano* ef, uint32_t k);
+
+// Decodes entries [first, last), the position list of seed, writing
+// p - offset for every position p >= offset to out and returning how many
+// were written.
+// Entries below offset are skipped with NextGEQ rather than decoded.
+// Sets *positions_read to the entries decoded.
+unsigned int DecodeEliasFanoList (const elias_fano* ef, uint64_t seed, uint32_t first, uint32_t last,
+                                  unsigned int offset, unsigned int* out, unsigned int* positions_read);
+
+// Intersects a sorted list1 with the position list of seed, entries
+// [first, last), whose positions lie offset ahead, like merge(). Each list1
+// entry is sought in the list with NextGEQ, which skips to the target's
+// bucket and then gallops over the entry samples, so a short list1 decodes
+// a handful of entries of a long repeat list rather than all of them. Sets
+// *positions_read to the entries decoded.
+unsigned int IntersectEliasFanoList (const unsigned int* list1, unsigned int length1, const elias_fano* ef,
+                                     uint64_t seed, uint32_t first, uint32_t last, unsigned int offset,
+                                     unsigned int* result, unsigned int* positions_read);
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef _hash_format_h
+#define _hash_format_h
+
+#include <stdint.h>
+
+// On-disk layout of the hash seed index, shared by gen_hash_tables and the
+// baseline so the two cannot drift apart.
+
+// One slot of the hash table: the position table interval [start, end) of
+// seed. A slot with start == end is empty. Slots are probed linearly from
+// HashSeedSlot(); four fit in a cache line.
+struct hash_slot {
+  uint64_t seed;
+  uint32_t start;
+  uint32_t end;
+};
+
+// Table words per slot, as counted in table::length
+#define HASH_SLOT_WORDS (sizeof(hash_slot) / sizeof(unsigned int))
+
+// Largest table, in log2 of its slots, whose length in table words still
+// fits the 32-bit table::length. At most half the slots are used, so it
+// indexes up to 2^28 distinct seeds.
+#define MAX_HASH_SLOT_BITS 29
+static_assert(((uint64_t) HASH_SLOT_WORDS << MAX_HASH_SLOT_BITS) <= 0xFFFFFFFFULL,
+              "the largest hash table must fit table::length");
+
+// Returns the home slot of seed in a table of 2^slot_bits slots
+// (multiplicative hashing).
+static inline uint64_t HashSeedSlot (uint64_t seed, unsigned int slot_bits) {
+  return (seed * 0x9E3779B97F4A7C15ULL) >> (64 - slot_bits);
+}
+
+#endif
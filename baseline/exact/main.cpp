@@ -1,40 +1,544 @@
 #include "table_io.h"
 #include "def.h"
+#include "options.h"
+#include "thread_pool.h"
+#include "merge.h"
+#include "scratch.h"
+#include "alloc_count.h"
+#include "results_writer.h"
+#include "verify.h"
+#include "bench.h"
+#include "perf_counters.h"
+#include "numa_placement.h"
+#include "strand.h"
+#include "sort_join.h"
+#include "result_cache.h"
+#include "seed_hash.h"
+#include "varint_positions.h"
+#include "packed_positions.h"
+#include "elias_fano.h"
+#include "contigs.h"
 #include <cmath>
+#include <algorithm>
 #include <iostream>
 #include <fstream>
+#include <string>
 #include <stdint.h>
 #include <vector>
+#include <mutex>
 #include <assert.h>
 #include <cstdlib>
-#include <ctime>
-#undef _BENCHMARK
-// Merges two sorted lists of positions, given a required offset (vec2 - vec1)
-void merge (std::vector<unsigned int>* vec1, std::vector<unsigned int>* vec2, std::vector<unsigned int>* result, unsigned int offset) {
-  unsigned int ptr1 = 0;
-  unsigned int ptr2 = 0;
-  
-  while (ptr2 < vec2->size() && (*vec2)[ptr2] < offset) {
-    ptr2++;
-  }
-  while ((ptr1 < vec1->size()) && (ptr2 < vec2->size())) {
-    if ((*vec1)[ptr1] == (*vec2)[ptr2] - offset) {
-      result->push_back((*vec1)[ptr1]);
-      ptr1++;
-      ptr2++;
-    } else if ((*vec1)[ptr1] > ((*vec2)[ptr2] - offset)) {
-      ptr2++;
+#include <cstring>
+#include <chrono>
+// Counters accumulated by each worker thread and summed at the end
+struct stitch_stats {
+  unsigned long long num_pt_accesses;
+  unsigned long long num_pt_skipped;       // planner: reads avoided vs. fetching every interval
+  unsigned long long num_short_circuited;  // planner: queries with an empty interval
+  unsigned long long num_allocations;      // heap allocations made while stitching
+  unsigned long long num_candidates;       // seed-and-verify: candidates checked
+  unsigned long long num_verified;         // seed-and-verify: candidates that matched
+  unsigned long long num_hits[2];          // hits on the forward and reverse strand
+  unsigned long long num_cache_lookups;    // result cache: queries looked up
+  unsigned long long num_cache_hits;       // result cache: duplicates served from it
+  merge_stats merges;
+  double fetch_seconds;                    // --bench: busy time per phase of the stitch pass
+  double stitch_seconds;
+  double output_seconds;
+};
+
+/* Splits a packed query into its subread_length-nucleotide subreads, storing
+ * num_subreads 2-bit encoded values at subreads. Trailing nucleotides that do
+ * not fill a whole subread are ignored.
+ */
+void SplitQuery (unsigned char* query, unsigned int subread_length, unsigned int num_subreads, uint64_t* subreads) {
+  unsigned int bit_index = 0;
+
+  for (unsigned int j = 0 ; j < num_subreads; j++) {
+    unsigned int byte = bit_index / 8;
+    unsigned int offset = bit_index % 8;
+    uint64_t subread = 0;
+    subread += query[byte] & (0xFF >> offset);
+    unsigned int bits_read = 8 - offset;
+    byte++;
+    while ((bits_read < subread_length*2) && (subread_length*2 - bits_read >= 8)) {
+      subread <<= 8;
+      subread += query[byte];
+      byte++;
+      bits_read += 8;
+    }
+    if (subread_length*2 - bits_read > 0) {
+      subread <<= (subread_length*2 - bits_read);
+      subread += query[byte] >> (8 - (subread_length*2 - bits_read));
+      bits_read += (subread_length*2 - bits_read);
+    }
+    subreads[j] = subread;
+    bit_index += (subread_length*2);
+  }
+}
+
+/* Splits a packed query into the num_subreads subreads that start at each
+ * of its first num_subreads nucleotides, for sampled position tables.
+ */
+void SplitQueryOffsets (unsigned char* query, unsigned int subread_length, unsigned int num_subreads,
+                        uint64_t* subreads) {
+  for (unsigned int j = 0; j < num_subreads; j++) {
+    subreads[j] = PackedWindow(query, j) >> (64 - subread_length * 2);
+  }
+}
+
+/* Orders the subreads of a query for stitching, shortest position table
+ * interval first, so the running intersection starts (and stays) as small
+ * as possible. Ties keep subread order. Returns false without ordering if
+ * any interval is empty, in which case the query cannot match at all.
+ */
+bool PlanQuery (uint32_t* starts, uint32_t* ends, unsigned int num_subreads, unsigned int* order) {
+  for (unsigned int j = 0; j < num_subreads; j++) {
+    if (ends[j] == starts[j]) {
+      return false;
+    }
+    // Insertion sort; there are only a handful of subreads per query
+    unsigned int length = ends[j] - starts[j];
+    unsigned int k = j;
+    while (k > 0 && ends[order[k-1]] - starts[order[k-1]] > length) {
+      order[k] = order[k-1];
+      k--;
+    }
+    order[k] = j;
+  }
+  return true;
+}
+
+// Read-only inputs shared by every StitchQuery() call over a chunk
+struct stitch_inputs {
+  query_list* qlist;
+  subread_list* srlist;        // the subreads ilist was looked up from
+  interval_list* ilist;
+  table* position_table;
+  const elias_fano* ef;        // --positions elias-fano: view of position_table, else NULL
+  reference* ref;              // packed reference when verifying, else NULL
+  unsigned int subread_length;
+  unsigned int num_strands;    // 2 with --both-strands, else 1
+  options* opts;
+};
+
+/* Prefetches the first cache line of the position list of every subread of
+ * query i, so the lists are on their way in before StitchQuery() needs them.
+ */
+void PrefetchPositions (unsigned int i, stitch_inputs* in) {
+  interval_list* ilist = in->ilist;
+  table* position_table = in->position_table;
+  unsigned int num_subreads = ilist->num_subreads_per_query;
+  uint32_t* starts = ilist->start + (size_t) i * num_subreads;
+  for (unsigned int j = 0; j < num_subreads; j++) {
+    if (position_table->format == POSITIONS_VARINT) {
+      __builtin_prefetch((unsigned char*) position_table->ptr + starts[j]);
+    } else if (position_table->format == POSITIONS_PACKED) {
+      __builtin_prefetch((unsigned char*) position_table->ptr + (((uint64_t) starts[j] * position_table->bits) >> 3));
+    } else if (in->ef != NULL) {
+      uint64_t seed = in->srlist->ptr[(size_t) i * num_subreads + j];
+      __builtin_prefetch(in->ef->high + (EliasFanoListBit(in->ef, seed, starts[j]) >> 6));
+      __builtin_prefetch(in->ef->low + (((uint64_t) starts[j] * in->ef->low_bits) >> 3));
+    } else {
+      __builtin_prefetch(position_table->ptr + starts[j]);
+    }
+  }
+}
+
+/* Fetches the position list of every subread of query i and stitches them
+ * together. With two strands, i = 2*query + strand indexes the interval
+ * list, which holds each query's forward subreads followed by those of its
+ * reverse complement. Returns the number of positions at which the whole query
+ * matches and points hits at them; the hits live in scratch's result arena
+ * until its next Reset().
+ *
+ * Subreads are stitched in index order unless opts->plan is set, in which
+ * case PlanQuery() picks the order. Either way the running result holds
+ * candidate positions of subread 0, so subread j is merged at offset
+ * j*subread_length and the first list fetched is shifted back to match.
+ * Later lists are merged straight out of the position table, and the
+ * running result ping-pongs between the two scratch buffers.
+ *
+ * With opts->kway the lists are instead intersected all at once by
+ * KWayMerge(), leapfrogging between them like the hardware Stitcher.
+ *
+ * A varint compressed position table is read the same way, except that the
+ * intervals are byte ranges of its stream: the first list is decoded by
+ * DecodeVarintList() and later lists are decoded inside the intersection
+ * by IntersectVarintList(). Position table accesses then count bytes.
+ * A bit-packed table is unpacked a whole interval at a time by
+ * UnpackPositions(), later lists into a scratch list that is then merged
+ * as usual. An Elias-Fano list at least opts->merge.gallop_ratio times
+ * longer than the running result is not decoded but intersected in place by
+ * IntersectEliasFanoList(), seeking every running result entry with
+ * NextGEQ; shorter ones are decoded and merged like packed lists. Position
+ * table accesses count only the entries actually decoded.
+ *
+ * When a reference is given (seed-and-verify), only the opts->verify_seeds
+ * rarest subreads are stitched. Each surviving candidate is then checked
+ * against the packed reference over all of the query's subreads. Only the
+ * short lists are fetched, never the long repeat lists.
+ */
+unsigned int StitchQuery (unsigned int i, stitch_inputs* in, StitchScratch* scratch, unsigned int** hits,
+                          stitch_stats* stats) {
+  options* opts = in->opts;
+  unsigned int subread_length = in->subread_length;
+  unsigned int num_subreads = in->ilist->num_subreads_per_query;
+  uint32_t* starts = in->ilist->start + (size_t) i * num_subreads;
+  uint32_t* ends = in->ilist->end + (size_t) i * num_subreads;
+  unsigned int* order = scratch->Order(num_subreads);
+  bool plan = opts->plan || in->ref != NULL;
+  unsigned int num_stitched = num_subreads;
+  if (in->ref != NULL && opts->verify_seeds < num_subreads) {
+    num_stitched = opts->verify_seeds;
+  }
+  unsigned long long num_reads = 0;
+  unsigned long long num_interval_reads = 0;
+  if (plan) {
+    for (unsigned int j = 0; j < num_subreads; j++) {
+      num_interval_reads += ends[j] - starts[j];
+    }
+    if (!PlanQuery(starts, ends, num_subreads, order)) {
+      stats->num_short_circuited++;
+      stats->num_pt_skipped += num_interval_reads;
+      *hits = NULL;
+      return 0;
+    }
+  } else {
+    for (unsigned int j = 0; j < num_subreads; j++) {
+      order[j] = j;
+    }
+  }
+
+  uint32_t pt_start, pt_end;
+  unsigned int* pt = in->position_table->ptr;
+  bool varint = in->position_table->format == POSITIONS_VARINT;
+  const unsigned char* pt_bytes = (const unsigned char*) pt;
+  bool packed = in->position_table->format == POSITIONS_PACKED;
+  unsigned int bits = in->position_table->bits;
+  const elias_fano* ef = in->ef;
+  uint64_t* seeds = in->srlist->ptr + (size_t) i * num_subreads;
+  unsigned int current = 0;
+  unsigned int* prev_result = NULL;
+  unsigned int prev_count = 0;
+  // With --bench, time spent reading position lists out of the table on
+  // their own, ahead of merging, is counted as fetch
+  bool timed = opts->bench_trials > 0;
+  double fetch_start = timed ? WallSeconds() : 0;
+  if (opts->kway && num_stitched > 1) {
+    // Single pass over all lists; the first one is read straight from the
+    // table like the rest instead of being copied and shifted, so fetching
+    // is only setting up the list heads
+    kway_list* lists = scratch->KWayLists(num_stitched);
+    unsigned int shortest = ~0U;
+    for (unsigned int r = 0; r < num_stitched; r++) {
+      unsigned int j = order[r];
+      lists[r].positions = pt + starts[j];
+      lists[r].length = ends[j] - starts[j];
+      lists[r].offset = j * subread_length;
+      num_reads += lists[r].length;
+      shortest = std::min(shortest, lists[r].length);
+    }
+    if (timed) {
+      stats->fetch_seconds += WallSeconds() - fetch_start;
+    }
+    scratch->Reserve(shortest);
+    prev_result = scratch->buffer(current);
+    prev_count = KWayMerge(lists, num_stitched, prev_result);
+    stats->merges.num_kway++;
+  } else {
+    unsigned int first = order[0];
+    unsigned int first_offset = first * subread_length;
+    pt_start = starts[first];
+    pt_end = ends[first];
+    // A compressed list has no more positions than bytes
+    scratch->Reserve(pt_end - pt_start);
+    prev_result = scratch->buffer(current);
+    if (varint) {
+      prev_count = DecodeVarintList(pt_bytes + pt_start, pt_end - pt_start, first_offset, prev_result,
+                                    opts->merge.backend);
+      num_reads += pt_end - pt_start;
+    } else if (packed) {
+      prev_count = UnpackPositions(pt_bytes, bits, pt_start, pt_end, first_offset, prev_result);
+      num_reads += pt_end - pt_start;
+    } else if (ef != NULL) {
+      unsigned int positions_read;
+      prev_count = DecodeEliasFanoList(ef, seeds[first], pt_start, pt_end, first_offset, prev_result,
+                                       &positions_read);
+      num_reads += positions_read;
+    } else {
+      for (unsigned int k = pt_start; k < pt_end; k++) {
+        unsigned int val = pt[k];
+        num_reads++;
+        if (val >= first_offset) {
+          prev_result[prev_count++] = val - first_offset;
+        }
+      }
+    }
+    if (timed) {
+      stats->fetch_seconds += WallSeconds() - fetch_start;
+    }
+
+    for (unsigned int r = 1; r < num_stitched; r++) {
+      unsigned int j = order[r];
+      if (plan && prev_count == 0) {
+        break;
+      }
+      pt_start = starts[j];
+      pt_end = ends[j];
+      if (!varint && ef == NULL) {
+        num_reads += pt_end - pt_start;
+      }
+      if (prev_count == 0) {
+        break;
+      }
+      // Results never outgrow prev_count, so the other buffer always has room
+      unsigned int* result = scratch->buffer(1 - current);
+      if (varint) {
+        unsigned int bytes_read;
+        prev_count = IntersectVarintList(prev_result, prev_count, pt_bytes + pt_start, pt_end - pt_start,
+                                         j*subread_length, result, opts->merge.backend, &bytes_read);
+        num_reads += bytes_read;
+        stats->merges.num_linear++;
+      } else if (ef != NULL && opts->merge.gallop_ratio != 0 &&
+                 pt_end - pt_start >= (uint64_t) prev_count * opts->merge.gallop_ratio) {
+        // Long list: seek into it rather than decode it
+        unsigned int positions_read;
+        prev_count = IntersectEliasFanoList(prev_result, prev_count, ef, seeds[j], pt_start, pt_end,
+                                            j*subread_length, result, &positions_read);
+        num_reads += positions_read;
+        stats->merges.num_galloping++;
+      } else if (ef != NULL) {
+        fetch_start = timed ? WallSeconds() : 0;
+        unsigned int* list = scratch->Unpacked(pt_end - pt_start);
+        unsigned int positions_read;
+        unsigned int length = DecodeEliasFanoList(ef, seeds[j], pt_start, pt_end, 0, list, &positions_read);
+        num_reads += positions_read;
+        if (timed) {
+          stats->fetch_seconds += WallSeconds() - fetch_start;
+        }
+        prev_count = AdaptiveMerge(prev_result, prev_count, list, length, j*subread_length,
+                                   result, &opts->merge, &stats->merges);
+      } else if (packed) {
+        fetch_start = timed ? WallSeconds() : 0;
+        unsigned int* list = scratch->Unpacked(pt_end - pt_start);
+        UnpackPositions(pt_bytes, bits, pt_start, pt_end, 0, list);
+        if (timed) {
+          stats->fetch_seconds += WallSeconds() - fetch_start;
+        }
+        prev_count = AdaptiveMerge(prev_result, prev_count, list, pt_end - pt_start, j*subread_length,
+                                   result, &opts->merge, &stats->merges);
+      } else {
+        prev_count = AdaptiveMerge(prev_result, prev_count, pt + pt_start, pt_end - pt_start, j*subread_length,
+                                   result, &opts->merge, &stats->merges);
+      }
+      current = 1 - current;
+      prev_result = result;
+    }
+  }
+  stats->num_pt_accesses += num_reads;
+  if (plan) {
+    stats->num_pt_skipped += num_interval_reads - num_reads;
+  }
+
+  if (num_stitched < num_subreads && prev_count > 0) {
+    unsigned int num_nucleotides = num_subreads * subread_length;
+    uint64_t* query_words = scratch->QueryWords(num_nucleotides);
+    unsigned char* query = in->qlist->ptr + (size_t) (i / in->num_strands) * in->qlist->bytes_per_query;
+    if (i % in->num_strands == 0) {
+      PackQueryWords(query, num_nucleotides, query_words);
+    } else {
+      PackReverseComplementWords(query, in->qlist->query_length, num_nucleotides, query_words);
+    }
+    unsigned int num_candidates = prev_count;
+    prev_count = 0;
+    for (unsigned int c = 0; c < num_candidates; c++) {
+      if (VerifyCandidate(in->ref, prev_result[c], query_words, num_nucleotides)) {
+        prev_result[prev_count++] = prev_result[c];
+      }
+    }
+    stats->num_candidates += num_candidates;
+    stats->num_verified += prev_count;
+  }
+
+  *hits = scratch->AllocateResult(prev_count);
+  memcpy(*hits, prev_result, prev_count * sizeof(unsigned int));
+  return prev_count;
+}
+
+/* Aligns query i against a position table that keeps only every step-th
+ * reference offset (gen_tables --sample), where the subreads of a query
+ * are its k-mers at every offset o rather than disjoint ones. A match at
+ * reference position P is sampled through exactly one residue r < step, at
+ * the offsets o = r, r + step, ... with (P + o) % step == 0. So for each
+ * residue only the shortest position list among those offsets is fetched,
+ * and each position p in it yields the candidate p - o, which is checked
+ * against the packed reference over the query's num_subreads_per_query *
+ * subread_length leading nucleotides (the span the disjoint subreads
+ * cover). Candidates of different residues are distinct; the hits are
+ * sorted before they are returned like StitchQuery()'s.
+ */
+unsigned int SampledQuery (unsigned int i, stitch_inputs* in, StitchScratch* scratch, unsigned int** hits,
+                           stitch_stats* stats) {
+  unsigned int step = in->position_table->step;
+  unsigned int num_offsets = in->ilist->num_subreads_per_query;
+  uint32_t* starts = in->ilist->start + (size_t) i * num_offsets;
+  uint32_t* ends = in->ilist->end + (size_t) i * num_offsets;
+  unsigned int* pt = in->position_table->ptr;
+  bool packed = in->position_table->format == POSITIONS_PACKED;
+
+  // Pick the rarest offset of each residue
+  unsigned int* order = scratch->Order(step);
+  unsigned int num_candidates = 0;
+  for (unsigned int r = 0; r < step; r++) {
+    order[r] = r;
+    for (unsigned int o = r + step; o < num_offsets; o += step) {
+      if (ends[o] - starts[o] < ends[order[r]] - starts[order[r]]) {
+        order[r] = o;
+      }
+    }
+    num_candidates += ends[order[r]] - starts[order[r]];
+  }
+  stats->num_pt_accesses += num_candidates;
+  stats->num_candidates += num_candidates;
+  if (num_candidates == 0) {
+    *hits = NULL;
+    return 0;
+  }
+
+  unsigned int num_nucleotides = num_offsets + in->subread_length - 1;
+  uint64_t* query_words = scratch->QueryWords(num_nucleotides);
+  unsigned char* query = in->qlist->ptr + (size_t) (i / in->num_strands) * in->qlist->bytes_per_query;
+  if (i % in->num_strands == 0) {
+    PackQueryWords(query, num_nucleotides, query_words);
+  } else {
+    PackReverseComplementWords(query, in->qlist->query_length, num_nucleotides, query_words);
+  }
+  // Fetch every candidate, then verify them in place
+  bool timed = in->opts->bench_trials > 0;
+  double fetch_start = timed ? WallSeconds() : 0;
+  scratch->Reserve(num_candidates);
+  unsigned int* result = scratch->buffer(0);
+  unsigned int num_fetched = 0;
+  for (unsigned int r = 0; r < step; r++) {
+    unsigned int o = order[r];
+    for (uint32_t k = starts[o]; k < ends[o]; k++) {
+      unsigned int val;
+      if (in->ef != NULL) {
+        val = EliasFanoPosition(in->ef, k);
+      } else if (packed) {
+        val = PackedPosition((unsigned char*) pt, in->position_table->bits, k);
+      } else {
+        val = pt[k];
+      }
+      if (val >= o) {
+        result[num_fetched++] = val - o;
+      }
+    }
+  }
+  if (timed) {
+    stats->fetch_seconds += WallSeconds() - fetch_start;
+  }
+  unsigned int count = 0;
+  for (unsigned int c = 0; c < num_fetched; c++) {
+    if (VerifyCandidate(in->ref, result[c], query_words, num_nucleotides)) {
+      result[count++] = result[c];
+    }
+  }
+  std::sort(result, result + count);
+  stats->num_verified += count;
+
+  *hits = scratch->AllocateResult(count);
+  memcpy(*hits, result, count * sizeof(unsigned int));
+  return count;
+}
+
+/* Looks up the position table interval of every subread in [first, last) of
+ * the flat subread list. With a non-zero prefetch_distance the loop is
+ * software-pipelined: the interval table entry of the subread that many
+ * places ahead is prefetched while the current one is resolved, so that
+ * many cache misses are in flight at once. Returns the number of interval
+ * table accesses.
+ */
+unsigned long long LookupIntervals (subread_list* srlist, size_t first, size_t last, table* interval_table,
+                                    size_t prefetch_distance, interval_list* ilist) {
+  unsigned int* it = interval_table->ptr;
+  if (prefetch_distance > 0) {
+    for (size_t s = first; s < first + prefetch_distance && s < last; s++) {
+      __builtin_prefetch(&it[srlist->ptr[s]]);
+    }
+  }
+  for (size_t s = first; s < last; s++) {
+    assert(srlist->ptr[s] < interval_table->length - 1);
+    if (prefetch_distance > 0 && s + prefetch_distance < last) {
+      __builtin_prefetch(&it[srlist->ptr[s + prefetch_distance]]);
+    }
+    uint64_t srlist_lookup = srlist->ptr[s];
+    ilist->start[s] = it[srlist_lookup];
+    ilist->end[s] = it[srlist_lookup + 1];
+  }
+  return (last - first) * 2;
+}
+
+/* Appends the forward subreads of the first num_queries queries of srlist
+ * to the ASCII subread file, one query per line.
+ */
+void WriteSubreads (std::ofstream* subread_file, subread_list* srlist, unsigned int num_queries, unsigned int subread_length,
+                    unsigned int num_strands) {
+  unsigned int num_subreads_per_query = srlist->num_subreads_per_query;
+  for (unsigned int i = 0 ; i < num_queries; i++) {
+    for (unsigned int j = 0; j < num_subreads_per_query; j++) {
+      uint64_t subread_shifted = srlist->ptr[((size_t) i * num_strands) * num_subreads_per_query + j] << (sizeof(uint64_t)*8 - subread_length*2);
+      for (unsigned int k = 0 ; k < subread_length; k++) {
+        unsigned int nucleotide = (unsigned int) (subread_shifted >> 62);
+        switch (nucleotide) {
+          case 0 : *subread_file << 'A'; break;
+          case 1 : *subread_file << 'C'; break;
+          case 2 : *subread_file << 'G'; break;
+          case 3 : *subread_file << 'T'; break;
+          default : *subread_file << 'X'; break;
+        }
+        subread_shifted <<= 2;
+      }
+      *subread_file << ' ';
+    }
+    *subread_file << std::endl;
+  }
+}
+
+/* Prints the events counted over one phase on a single summary line.
+ */
+void PrintPerfSample (const char* phase, const perf_sample* sample, PerfCounters* counters) {
+  std::cout << "Counters (" << phase << "):";
+  for (int e = 0; e < NUM_PERF_EVENTS; e++) {
+    std::cout << "  " << PerfEventName(e) << " ";
+    if (counters->available(e)) {
+      std::cout << sample->count[e];
     } else {
-      ptr1++;
+      std::cout << "n/a";
     }
   }
+  if (sample->count[PERF_CYCLES] > 0) {
+    std::cout << "  ipc " << (double) sample->count[PERF_INSTRUCTIONS] / sample->count[PERF_CYCLES];
+  }
+  std::cout << std::endl;
 }
 
 int main (int argc, char** argv) {
-  if (argc < 5) {
-    std::cout << "Usage: " << argv[0] << " <Subread Length> <Interval Table Filename> <Position Table Filename> <Queries Filename> <Output Filename> [Subread Filename]" << std::endl;
+  options opts;
+  if (!ParseOptions(&argc, argv, &opts) || argc < 5) {
+    std::cout << "Usage: " << argv[0] << " [Options] <Subread Length> <Interval Table Filename> <Position Table Filename> <Queries Filename> <Output Filename> [Subread Filename]" << std::endl;
+    PrintOptionsUsage();
     exit(1);
   }
+
+  // With --bench and no --bench-json file the JSON report is the only thing
+  // written to standard output, so it can be piped straight into a parser;
+  // progress, table and summary lines go to standard error meanwhile
+  std::streambuf* stdout_buffer = std::cout.rdbuf();
+  if (opts.bench_trials > 0 && opts.bench_json == NULL) {
+    std::cout.rdbuf(std::cerr.rdbuf());
+  }
   
   std::ifstream queries_file;
   unsigned int num_queries;
@@ -44,203 +548,755 @@ int main (int argc, char** argv) {
   queries_file.read((char *)(&query_length), sizeof(unsigned int));
   
   unsigned int subread_length = atoi(argv[1]);
+  std::string reverse_filename = std::string(argv[5]) + ".rc";
   unsigned int num_subreads_per_query = query_length / subread_length; // Truncating partial subreads
+  unsigned int max_subread_length = (opts.index == INDEX_HASH) ? MAX_HASH_SEED_LENGTH : MAX_DENSE_SEED_LENGTH;
+  if (subread_length == 0 || subread_length > max_subread_length) {
+    std::cout << "Subread length must be 1 to " << max_subread_length << " with the " << SeedIndexName(opts.index)
+              << " index" << (opts.index == INDEX_DENSE ? " (use --index hash for longer seeds)" : "") << std::endl;
+    exit(1);
+  }
+  if (opts.sort_join && opts.index != INDEX_DENSE) {
+    std::cout << "--sort-join sweeps the dense interval table and cannot be used with --index hash" << std::endl;
+    exit(1);
+  }
+  if (opts.positions != POSITIONS_RAW && (opts.index != INDEX_DENSE || opts.kway)) {
+    std::cout << "--positions " << PositionFormatName(opts.positions) << " needs a dense interval table and"
+              << " cannot be used with --index hash or --kway" << std::endl;
+    exit(1);
+  }
+
+  // Queries are read and aligned a chunk at a time. Without --chunk the whole
+  // file is one chunk; with it, memory use is bounded by the chunk size no
+  // matter how many queries the file holds, and results appear as each
+  // chunk completes.
+  unsigned int chunk_size = num_queries;
+  if (opts.chunk_size != 0 && opts.chunk_size < num_queries) {
+    chunk_size = opts.chunk_size;
+  }
+  bool streaming = chunk_size < num_queries;
+
+  // Within a chunk, queries are handed out to the worker threads in
+  // fixed-size batches. With a single thread the batches simply run in order
+  // on the main thread.
+  unsigned int batch_size = opts.batch_size;
+  if (opts.num_threads > 1) {
+    std::cout << "Using " << opts.num_threads << " threads, batches of " << batch_size << " queries" << std::endl;
+  }
+  if (streaming) {
+    std::cout << "Streaming queries in chunks of " << chunk_size << std::endl;
+  }
+
+  // With --numa the workers are split over the nodes in contiguous blocks
+  // and pinned there; thread_node maps each worker to its node's index in
+  // the topology
+  numa_topology topology;
+  std::vector<unsigned int> thread_node(opts.num_threads, 0);
+  std::vector<std::vector<int> > worker_cpus(opts.num_threads);
+  if (opts.numa != NUMA_OFF) {
+    if (!ReadNumaTopology(&topology)) {
+      std::cout << "No NUMA topology found, treating the host as one node" << std::endl;
+    }
+    for (unsigned int t = 0; t < opts.num_threads; t++) {
+      thread_node[t] = (unsigned int) ((unsigned long long) t * topology.nodes.size() / opts.num_threads);
+      worker_cpus[t] = topology.cpus[thread_node[t]];
+    }
+    std::cout << "NUMA policy " << NumaPolicyName(opts.numa) << " over " << topology.nodes.size() << " nodes"
+              << std::endl;
+  }
+
+  // With --perf, hardware events are counted around each phase. The counters
+  // are opened before the pool starts its workers so that they follow them.
+  // The stitch phase covers position fetches, merging and formatting each
+  // batch's results; output is the final flush.
+  PerfCounters counters;
+  bool perf = opts.perf && counters.Open();
+  if (opts.perf && !perf) {
+    std::cout << "Hardware counters unavailable (" << counters.error() << "), continuing without them" << std::endl;
+  }
+  perf_sample perf_phases[NUM_BENCH_PHASES];
+  perf_sample perf_before, perf_after;
+  auto count_from = [&]() {
+    if (perf) {
+      counters.Read(&perf_before);
+    }
+  };
+  auto count_to = [&](int phase) {
+    if (perf) {
+      counters.Read(&perf_after);
+      AccumulateSample(&perf_before, &perf_after, &perf_phases[phase]);
+    }
+  };
+
+  // The workers start here, pinned, and wait between passes until the pool
+  // goes out of scope
+  WorkStealingPool pool(opts.num_threads, worker_cpus);
   
-  // Read in query list
-  std::cout << "Reading query list" << std::endl;
+  // With --bench the whole query file is aligned bench_warmup +
+  // bench_trials times against tables loaded once, timing each phase on the
+  // wall clock. Progress messages are suppressed while timing.
+  bool bench = opts.bench_trials > 0;
+  bool progress = !streaming && !bench;
+  unsigned int num_trials = bench ? opts.bench_warmup + opts.bench_trials : 1;
+  bench_report report;
+  report.num_queries = num_queries;
+  report.query_length = query_length;
+  report.subread_length = subread_length;
+  for (int e = 0; e < NUM_PERF_EVENTS; e++) {
+    report.counters[e] = perf && counters.available(e);
+  }
+  if (bench) {
+    std::cout << "Benchmarking " << opts.bench_trials << " trials after " << opts.bench_warmup
+              << " warm-up (no more output until done)..." << std::endl;
+  }
+
+  // Read in Interval and Position Tables
+  std::cout << "Reading interval and position tables" << std::endl;
+  double load_start = WallSeconds();
+  table interval_table = table();
+  table position_table = table();
+  // With --index hash, interval_table holds the hash seed index instead
+  if (opts.use_mmap) {
+    if (opts.index == INDEX_HASH) {
+      MapHashTable(argv[2], subread_length, &interval_table, opts.mmap_populate, opts.mmap_advice);
+    } else {
+      MapIntervalTable(argv[2], &interval_table, opts.mmap_populate, opts.mmap_advice);
+    }
+    if (opts.positions == POSITIONS_VARINT) {
+      MapVarintPositionTable(argv[3], &position_table, opts.mmap_populate, opts.mmap_advice);
+    } else if (opts.positions == POSITIONS_PACKED) {
+      MapPackedPositionTable(argv[3], &position_table, opts.mmap_populate, opts.mmap_advice);
+    } else if (opts.positions == POSITIONS_ELIAS_FANO) {
+      MapEliasFanoPositionTable(argv[3], &position_table, opts.mmap_populate, opts.mmap_advice);
+    } else {
+      MapPositionTable(argv[3], &position_table, opts.mmap_populate, opts.mmap_advice);
+    }
+  } else {
+    // The tables are placed by the memory policy in force while they are
+    // read, since reading them is what first touches their pages
+    bool placed = true;
+    if (opts.numa == NUMA_REPLICATE) {
+      placed = BindMemory(topology.nodes[0]);
+    } else if (opts.numa == NUMA_INTERLEAVE) {
+      placed = InterleaveMemory(&topology);
+    }
+    if (opts.index == INDEX_HASH) {
+      ReadHashTable(argv[2], subread_length, &interval_table, opts.huge_pages);
+    } else {
+      ReadIntervalTable(argv[2], &interval_table, opts.huge_pages);
+    }
+    if (opts.numa != NUMA_OFF) {
+      placed = InterleaveMemory(&topology) && placed;
+    }
+    if (opts.positions == POSITIONS_VARINT) {
+      ReadVarintPositionTable(argv[3], &position_table, opts.huge_pages);
+    } else if (opts.positions == POSITIONS_PACKED) {
+      ReadPackedPositionTable(argv[3], &position_table, opts.huge_pages);
+    } else if (opts.positions == POSITIONS_ELIAS_FANO) {
+      ReadEliasFanoPositionTable(argv[3], &position_table, opts.huge_pages);
+    } else {
+      ReadPositionTable(argv[3], &position_table, opts.huge_pages);
+    }
+    if (opts.numa != NUMA_OFF) {
+      ResetMemoryPolicy();
+      if (!placed) {
+        std::cout << "Could not set the NUMA memory policy, tables use default placement" << std::endl;
+      }
+    }
+    if (opts.huge_pages != PAGES_DEFAULT) {
+      std::cout << "Table pages: interval " << TablePagesName(interval_table.pages) << ", position "
+                << TablePagesName(position_table.pages) << " (requested " << TablePagesName(opts.huge_pages)
+                << ")" << std::endl;
+    }
+  }
+  contig_table contigs;
+  if (opts.contigs != NULL) {
+    ReadContigTable(opts.contigs, &contigs);
+    std::cout << "Contigs: " << contigs.num_contigs << " in the joined reference" << std::endl;
+  }
+  reference ref;
+  if (opts.verify_ref != NULL) {
+    std::cout << "Reading reference sequence" << std::endl;
+    ReadReference(opts.verify_ref, &ref);
+  }
+  // With --numa replicate, the first node looks up in the table as loaded
+  // and every other node in its own copy
+  std::vector<table> replicas(opts.numa == NUMA_REPLICATE ? topology.nodes.size() - 1 : 0);
+  std::vector<table*> node_interval_table(std::max<size_t>(topology.nodes.size(), 1), &interval_table);
+  for (size_t n = 1; n <= replicas.size(); n++) {
+    BindMemory(topology.nodes[n]);
+    CopyTable(&interval_table, interval_table.pages, &replicas[n - 1]);
+    ResetMemoryPolicy();
+    node_interval_table[n] = &replicas[n - 1];
+  }
+  report.table_load_seconds = WallSeconds() - load_start;
+  report.numa_nodes = topology.nodes;
+  report.interval_pages = TablePagesName(interval_table.pages);
+  report.position_pages = TablePagesName(position_table.pages);
+  report.interval_bytes = (size_t) interval_table.length * sizeof(unsigned int);
+  report.position_bytes = (position_table.format == POSITIONS_VARINT) ? position_table.stream_bytes
+                                                                      : (size_t) position_table.length * sizeof(unsigned int);
+  report.position_step = position_table.step;
+  if (position_table.format == POSITIONS_VARINT) {
+    std::cout << "Position table: varint stream of " << report.position_bytes << " bytes, "
+              << VarintDecoderName(opts.merge.backend) << " decoder" << std::endl;
+  } else if (position_table.format == POSITIONS_PACKED) {
+    std::cout << "Position table: " << position_table.bits << " bits per position, " << report.position_bytes
+              << " bytes" << std::endl;
+  }
+  elias_fano ef;
+  if (position_table.format == POSITIONS_ELIAS_FANO) {
+    EliasFanoView(argv[3], &position_table, &ef);
+    std::cout << "Position table: Elias-Fano with " << ef.low_bits << " low bits, " << report.position_bytes
+              << " bytes (" << (ef.num_positions ? 8.0 * report.position_bytes / ef.num_positions : 0)
+              << " bits per position)" << std::endl;
+  }
+
+  // A position table sampled every step-th offset is searched through the
+  // k-mers at every offset of the span the disjoint subreads cover, and its
+  // candidates are verified against the reference (see SampledQuery())
+  bool sampled = position_table.step > 1;
+  if (sampled) {
+    unsigned int num_offsets = num_subreads_per_query * subread_length - subread_length + 1;
+    if (opts.verify_ref == NULL) {
+      std::cout << "A sampled position table needs the reference: --verify REF" << std::endl;
+      exit(1);
+    }
+    if (num_subreads_per_query == 0 || num_offsets < position_table.step) {
+      std::cout << "Queries are too short for a position table sampled every " << position_table.step
+                << " offsets" << std::endl;
+      exit(1);
+    }
+    num_subreads_per_query = num_offsets;
+    std::cout << "Position table sampled every " << position_table.step << " offsets, looking up "
+              << num_offsets << " subreads per query" << std::endl;
+  }
+
+  // With --bench, a table in huge pages is compared against a second copy of
+  // the interval table in default pages, the way it would have been loaded
+  // without --hugepages
+  table small_page_table = table();
+  bool compare_pages = bench && interval_table.pages != PAGES_DEFAULT;
+  if (compare_pages && opts.index == INDEX_HASH) {
+    ReadHashTable(argv[2], subread_length, &small_page_table, PAGES_DEFAULT);
+  } else if (compare_pages) {
+    ReadIntervalTable(argv[2], &small_page_table, PAGES_DEFAULT);
+  }
+
+  // With --both-strands every query is also aligned as its reverse
+  // complement. The reverse subreads are derived from the packed query
+  // during the split and stored right after the forward ones, so both sets
+  // are looked up and stitched in the same pass over the tables.
+  unsigned int strands = opts.both_strands ? 2 : 1;
+
+  // Query, subread and interval lists are sized for one chunk and reused
   query_list qlist;
-  qlist.num_queries = num_queries;
+  qlist.num_queries = chunk_size;
   qlist.query_length = query_length;
   unsigned int bytes_per_query = (unsigned int) ceil((float)query_length/4);
-  qlist.ptr = new unsigned char*[num_queries];
-  for (unsigned int i = 0; i < num_queries; i++) {
-    qlist.ptr[i] = new unsigned char[bytes_per_query];
-    queries_file.read((char *)(qlist.ptr[i]), bytes_per_query * sizeof(unsigned char));
-  }
-  
-  // Split query list into subread list
-  std::cout << "Splitting query list into subread list" << std::endl;
+  qlist.bytes_per_query = bytes_per_query;
+  // Padded so word-sized reads of the last query stay in bounds
+  qlist.ptr = new unsigned char[(size_t) chunk_size * bytes_per_query + 16];
+
   subread_list srlist;
-  srlist.num_queries = num_queries;
+  srlist.num_queries = chunk_size * strands;
   srlist.num_subreads_per_query = num_subreads_per_query;
-  
-  srlist.ptr = new uint32_t*[num_queries];
-  for (unsigned int i = 0; i < num_queries; i++) {
-    srlist.ptr[i] = new uint32_t[num_subreads_per_query];
-  }
-  for (unsigned int i = 0; i < num_queries; i++) {
-    unsigned int bit_index = 0;
-    
-    for (unsigned int j = 0 ; j < num_subreads_per_query; j++) {
-      unsigned int byte = bit_index / 8;
-      unsigned int offset = bit_index % 8;
-      uint32_t subread = 0;
-      subread += qlist.ptr[i][byte] & (0xFF >> offset);
-      unsigned int bits_read = 8 - offset;
-      byte++;
-      while ((bits_read < subread_length*2) && (subread_length*2 - bits_read >= 8)) {
-        subread <<= 8;
-        subread += qlist.ptr[i][byte];
-        byte++;
-        bits_read += 8;
-      }
-      if (subread_length*2 - bits_read > 0) {
-        subread <<= (subread_length*2 - bits_read);
-        subread += qlist.ptr[i][byte] >> (8 - (subread_length*2 - bits_read));
-        bits_read += (subread_length*2 - bits_read);
-      }
-      srlist.ptr[i][j] = subread;
-      bit_index += (subread_length*2);
-    }
+  srlist.ptr = new uint64_t[(size_t) chunk_size * strands * num_subreads_per_query];
+
+  interval_list ilist;
+  ilist.num_queries = chunk_size * strands;
+  ilist.num_subreads_per_query = num_subreads_per_query;
+  ilist.start = new uint32_t[(size_t) chunk_size * strands * num_subreads_per_query];
+  ilist.end = new uint32_t[(size_t) chunk_size * strands * num_subreads_per_query];
+
+  // With --sort-join the whole chunk's subreads are sorted before lookup
+  uint64_t* join_keys = NULL;
+  uint64_t* join_temp = NULL;
+  if (opts.sort_join) {
+    join_keys = new uint64_t[(size_t) chunk_size * strands * num_subreads_per_query];
+    join_temp = new uint64_t[(size_t) chunk_size * strands * num_subreads_per_query];
   }
 
-  // Write subread list into ascii file
+  std::ofstream subread_file;
   if (argc == 7) {
-    std::ofstream subread_file;
     subread_file.open(argv[6]);
     subread_file << num_queries << std::endl;
     subread_file << query_length << std::endl;
     subread_file << subread_length << std::endl;
-    for (unsigned int i = 0 ; i < num_queries; i++) {
-      for (unsigned int j = 0; j < num_subreads_per_query; j++) {
-        unsigned int subread_shifted = srlist.ptr[i][j] << (sizeof(uint32_t)*8 - subread_length*2);
-        for (unsigned int k = 0 ; k < subread_length; k++) {
-          unsigned int nucleotide = (subread_shifted & (0xC0000000)) >> 30;
-          switch (nucleotide) {
-            case 0 : subread_file << 'A'; break;
-            case 1 : subread_file << 'C'; break;
-            case 2 : subread_file << 'G'; break;
-            case 3 : subread_file << 'T'; break;
-            default : subread_file << 'X'; break;
+  }
+
+  // Access counts and stitching state are kept per thread; counts are
+  // summed at the end.
+  std::vector<unsigned long long> num_it_accesses(pool.num_threads(), 0);
+  std::vector<stitch_stats> thread_stats(pool.num_threads(), stitch_stats());
+  std::vector<StitchScratch*> scratch(pool.num_threads());
+  std::vector<std::vector<unsigned int*> > batch_hits(pool.num_threads());
+  std::vector<std::vector<unsigned int> > batch_hit_counts(pool.num_threads());
+  std::vector<std::vector<uint64_t> > stitch_order(pool.num_threads());
+  for (unsigned int t = 0; t < pool.num_threads(); t++) {
+    scratch[t] = new StitchScratch;
+    batch_hits[t].resize(batch_size * strands);
+    batch_hit_counts[t].resize(batch_size * strands);
+    stitch_order[t].resize(batch_size * strands);
+  }
+  std::chrono::duration<double> lookup_time(0);
+  // Per-query stitch latencies in microseconds, for --bench percentiles:
+  // from the cache probe to the hits being ready, lookup and output being
+  // batched per chunk. Each chunk's samples are binned into
+  // latency_counts once it is stitched, so memory stays bounded by the chunk.
+  std::vector<float> latencies(bench ? chunk_size : 0);
+  latency_histogram* latency_counts = new latency_histogram;
+
+  // With --cache N duplicate reads are served from the result cache. It is
+  // emptied before every trial so each one sees the same hit rate. Reads
+  // already cached when their chunk is looked up, or repeating an earlier
+  // read of the chunk, skip their interval lookups too, flagged per strand
+  // slot in cache_served; one the cache turns out not to hold when it is
+  // stitched is looked up then.
+  ResultCache* cache = NULL;
+  std::vector<unsigned char> cache_served;
+  if (opts.cache_entries > 0) {
+    cache = new ResultCache(opts.cache_entries, bytes_per_query);
+    cache_served.resize((size_t) chunk_size * strands);
+  }
+
+  stitch_inputs inputs;
+  inputs.qlist = &qlist;
+  inputs.srlist = &srlist;
+  inputs.ilist = &ilist;
+  inputs.position_table = &position_table;
+  inputs.ef = (position_table.format == POSITIONS_ELIAS_FANO) ? &ef : NULL;
+  inputs.ref = (opts.verify_ref != NULL) ? &ref : NULL;
+  inputs.subread_length = subread_length;
+  inputs.num_strands = strands;
+  inputs.opts = &opts;
+
+  for (unsigned int trial = 0; trial < num_trials; trial++) {
+    // Every trial starts from the first query; the counters printed at the
+    // end describe the last trial alone
+    queries_file.clear();
+    queries_file.seekg(2 * sizeof(unsigned int));
+    std::fill(num_it_accesses.begin(), num_it_accesses.end(), 0);
+    std::fill(thread_stats.begin(), thread_stats.end(), stitch_stats());
+    memset(perf_phases, 0, sizeof(perf_phases));
+    if (cache != NULL) {
+      cache->Clear();
+    }
+    ClearLatencies(latency_counts);
+    bench_trial times = bench_trial();
+    times.warmup = trial < opts.bench_warmup && bench;
+    double stitch_pass_seconds = 0;
+    double trial_start = WallSeconds();
+
+    ResultsWriter results_file(argv[5], opts.output_format, opts.output_buffer_size);
+    results_file.WriteHeader(num_queries);
+    // Reverse strand hits go to a second results file, in the same format as
+    // a separate run over the reverse-complemented queries would write
+    ResultsWriter* reverse_file = NULL;
+    if (strands == 2) {
+      reverse_file = new ResultsWriter(reverse_filename.c_str(), opts.output_format, opts.output_buffer_size);
+      reverse_file->WriteHeader(num_queries);
+    }
+    ResultsWriter* strand_files[2] = {&results_file, reverse_file};
+
+    for (unsigned int chunk_first = 0; chunk_first < num_queries; chunk_first += chunk_size) {
+      unsigned int chunk_queries = std::min(chunk_size, num_queries - chunk_first);
+      unsigned int num_batches = (chunk_queries + batch_size - 1) / batch_size;
+      if (streaming && !bench) {
+        std::cout << "Queries " << chunk_first + 1 << " to " << chunk_first + chunk_queries
+                  << " out of " << num_queries << std::endl;
+      }
+
+      // Read in query list
+      if (progress) {
+        std::cout << "Reading query list" << std::endl;
+      }
+      double phase_start = WallSeconds();
+      queries_file.read((char *)(qlist.ptr), (size_t) chunk_queries * bytes_per_query * sizeof(unsigned char));
+      times.phase_seconds[PHASE_LOAD] += WallSeconds() - phase_start;
+
+      // Split query list into subread list
+      if (progress) {
+        std::cout << "Splitting query list into subread list" << std::endl;
+      }
+      phase_start = WallSeconds();
+      count_from();
+      pool.Run(num_batches, [&](unsigned int batch, unsigned int thread) {
+        unsigned int last = std::min(chunk_queries, (batch + 1) * batch_size);
+        for (unsigned int i = batch * batch_size; i < last; i++) {
+          uint64_t* subreads = srlist.ptr + (size_t) i * strands * num_subreads_per_query;
+          if (sampled) {
+            SplitQueryOffsets(qlist.ptr + (size_t) i * bytes_per_query, subread_length, num_subreads_per_query,
+                              subreads);
+          } else {
+            SplitQuery(qlist.ptr + (size_t) i * bytes_per_query, subread_length, num_subreads_per_query, subreads);
+          }
+          if (strands == 2) {
+            SplitReverseComplement(qlist.ptr + (size_t) i * bytes_per_query, query_length, subread_length,
+                                   sampled ? 1 : subread_length, num_subreads_per_query,
+                                   subreads + num_subreads_per_query);
+          }
+        }
+      });
+      count_to(PHASE_SPLIT);
+      times.phase_seconds[PHASE_SPLIT] += WallSeconds() - phase_start;
+
+      // Write subread list into ascii file
+      if (argc == 7 && trial == 0) {
+        WriteSubreads(&subread_file, &srlist, chunk_queries, subread_length, strands);
+      }
+
+      // Look up intervals for each subread
+      if (progress) {
+        std::cout << "Performing interval table lookups" << std::endl;
+      }
+      std::chrono::steady_clock::time_point lookup_start = std::chrono::steady_clock::now();
+      count_from();
+      size_t subreads_per_query = (size_t) strands * num_subreads_per_query;
+      size_t chunk_subreads = chunk_queries * subreads_per_query;
+      size_t prefetch_distance = opts.prefetch_group * subreads_per_query;
+      if (opts.sort_join) {
+        SortSubreadKeys(srlist.ptr, chunk_subreads, 2 * subread_length, join_keys, join_temp);
+      }
+      // Each batch resolves a contiguous run of queries, or with --sort-join
+      // an equal share of the sorted keys. fixed_table overrides the
+      // thread's own (NUMA local) interval table.
+      auto lookup_slots = [&](unsigned int first_slot, unsigned int last_slot, table* it) {
+        size_t first = (size_t) first_slot * num_subreads_per_query;
+        size_t last = (size_t) last_slot * num_subreads_per_query;
+        if (first == last) {
+          return 0ULL;
+        }
+        if (opts.index == INDEX_HASH) {
+          return LookupHashIntervals(&srlist, first, last, it, prefetch_distance, &ilist);
+        }
+        return LookupIntervals(&srlist, first, last, it, prefetch_distance, &ilist);
+      };
+      auto lookup_pass = [&](table* fixed_table, std::vector<unsigned long long>* accesses) {
+        pool.Run(num_batches, [&](unsigned int batch, unsigned int thread) {
+          table* it = (fixed_table != NULL) ? fixed_table : node_interval_table[thread_node[thread]];
+          if (opts.sort_join) {
+            size_t first = chunk_subreads * batch / num_batches;
+            size_t last = chunk_subreads * (batch + 1) / num_batches;
+            (*accesses)[thread] += SweepIntervals(join_keys, first, last, it, &ilist);
+            return;
+          }
+          unsigned int first_slot = batch * batch_size * strands;
+          unsigned int last_slot = std::min(chunk_queries, (batch + 1) * batch_size) * strands;
+          if (cache == NULL) {
+            (*accesses)[thread] += lookup_slots(first_slot, last_slot, it);
+            return;
+          }
+          // Look up each run of slots the cache will not serve in one call, so
+          // prefetching still spans the run
+          unsigned int run_start = first_slot;
+          for (unsigned int v = first_slot; v <= last_slot; v++) {
+            if (v == last_slot || cache_served[v]) {
+              (*accesses)[thread] += lookup_slots(run_start, v, it);
+              run_start = v + 1;
+            }
+          }
+        });
+      };
+      if (cache != NULL && !opts.sort_join) {
+        cache->MarkServed(qlist.ptr, chunk_queries, strands, cache_served.data());
+      }
+      lookup_pass(NULL, &num_it_accesses);
+      count_to(PHASE_LOOKUP);
+      std::chrono::duration<double> chunk_lookup_time = std::chrono::steady_clock::now() - lookup_start;
+      lookup_time += chunk_lookup_time;
+      times.phase_seconds[PHASE_LOOKUP] += chunk_lookup_time.count();
+
+      // Repeat the lookups against the default page copy. The results are
+      // identical, and the time is left out of the trial's own phases.
+      if (compare_pages) {
+        double compare_start = WallSeconds();
+        std::vector<unsigned long long> uncounted(pool.num_threads(), 0);
+        lookup_pass(&small_page_table, &uncounted);
+        double compare_seconds = WallSeconds() - compare_start;
+        times.small_page_lookup_seconds += compare_seconds;
+        trial_start += compare_seconds;
+      }
+
+      // Look up positions for each subread
+      if (progress) {
+        std::cout << "Performing position table lookups" << std::endl;
+      }
+      // Each batch stitches all of its queries into the thread's scratch arena,
+      // then formats the hits into its own buffer. Whichever thread completes
+      // the oldest outstanding batch writes out every finished batch from there
+      // on, so the results file stays in query order.
+      std::vector<std::string> batch_output(num_batches * strands);
+      std::vector<char> batch_done(num_batches, 0);
+      unsigned int next_output_batch = 0;
+      std::mutex output_lock;
+      phase_start = WallSeconds();
+      count_from();
+      pool.Run(num_batches, [&](unsigned int batch, unsigned int thread) {
+        unsigned int first = batch * batch_size;
+        unsigned int last = std::min(chunk_queries, (batch + 1) * batch_size);
+        unsigned int** hits = batch_hits[thread].data();
+        unsigned int* hit_counts = batch_hit_counts[thread].data();
+        stitch_stats* stats = &thread_stats[thread];
+        unsigned long long allocations_before = ThreadHeapAllocations();
+        // Each strand of query i is stitched as v = i*strands + strand, into
+        // hit slot v - first*strands. With --sort-join the slots are taken in
+        // ascending order of their first subread's position list, so the
+        // batch walks the position table forwards instead of at random.
+        unsigned int num_slots = (last - first) * strands;
+        uint64_t* slot_order = stitch_order[thread].data();
+        for (unsigned int slot = 0; slot < num_slots; slot++) {
+          uint64_t list_start = 0;
+          if (opts.sort_join) {
+            list_start = ilist.start[(size_t) (first * strands + slot) * num_subreads_per_query];
+          }
+          slot_order[slot] = (list_start << 32) | slot;
+        }
+        if (opts.sort_join) {
+          std::sort(slot_order, slot_order + num_slots);
+        }
+        if (bench) {
+          std::fill(latencies.begin() + first, latencies.begin() + last, 0.0f);
+        }
+        unsigned int group = opts.prefetch_group * strands;
+        // Slots served from the cache were never looked up
+        auto prefetch = [&](unsigned int v) {
+          if (cache == NULL || opts.sort_join || !cache_served[v]) {
+            PrefetchPositions(v, &inputs);
+          }
+        };
+        for (unsigned int r = 0; r < group && r < num_slots; r++) {
+          prefetch(first * strands + (uint32_t) slot_order[r]);
+        }
+        for (unsigned int r = 0; r < num_slots; r++) {
+          if (group > 0 && r + group < num_slots) {
+            prefetch(first * strands + (uint32_t) slot_order[r + group]);
+          }
+          unsigned int slot = (uint32_t) slot_order[r];
+          unsigned int v = first * strands + slot;
+          double query_start = bench ? WallSeconds() : 0;
+          unsigned char* query = qlist.ptr + (size_t) (v / strands) * bytes_per_query;
+          bool skipped_lookup = cache != NULL && !opts.sort_join && cache_served[v];
+          if (cache != NULL && cache->Lookup(query, v % strands, scratch[thread], &hits[slot], &hit_counts[slot])) {
+            stats->num_cache_hits++;
+          } else {
+            if (skipped_lookup) {
+              // Not cached after all (evicted, too many hits, or its first
+              // occurrence is still being stitched): look it up now
+              num_it_accesses[thread] += lookup_slots(v, v + 1, node_interval_table[thread_node[thread]]);
+            }
+            if (sampled) {
+              hit_counts[slot] = SampledQuery(v, &inputs, scratch[thread], &hits[slot], stats);
+            } else {
+              hit_counts[slot] = StitchQuery(v, &inputs, scratch[thread], &hits[slot], stats);
+            }
+            if (cache != NULL) {
+              cache->Insert(query, v % strands, hits[slot], hit_counts[slot]);
+            }
+          }
+          if (cache != NULL) {
+            stats->num_cache_lookups++;
+          }
+          stats->num_hits[v % strands] += hit_counts[slot];
+          if (bench) {
+            double query_seconds = WallSeconds() - query_start;
+            latencies[v / strands] += (float) (query_seconds * 1e6);
+            stats->stitch_seconds += query_seconds;
+          }
+        }
+        stats->num_allocations += ThreadHeapAllocations() - allocations_before;
+        double output_start = bench ? WallSeconds() : 0;
+        std::string output[2];
+        for (unsigned int i = first; i < last; i++) {
+          for (unsigned int s = 0; s < strands; s++) {
+            unsigned int slot = (i - first) * strands + s;
+            if (opts.contigs != NULL) {
+              // Hits cover the subreads' span of the query
+              FormatContigResult(opts.output_format, chunk_first + i, hits[slot], hit_counts[slot], &contigs,
+                                 num_subreads_per_query * subread_length, &output[s]);
+            } else {
+              FormatResult(opts.output_format, chunk_first + i, hits[slot], hit_counts[slot], &output[s]);
+            }
           }
-          subread_shifted <<= 2;
         }
-        subread_file << ' ';
+        scratch[thread]->Reset();
+        {
+          std::lock_guard<std::mutex> guard(output_lock);
+          for (unsigned int s = 0; s < strands; s++) {
+            batch_output[batch * strands + s].swap(output[s]);
+          }
+          batch_done[batch] = 1;
+          while (next_output_batch < num_batches && batch_done[next_output_batch]) {
+            unsigned int out_first = chunk_first + next_output_batch * batch_size;
+            unsigned int out_last = chunk_first + std::min(chunk_queries, (next_output_batch + 1) * batch_size);
+            for (unsigned int i = (out_first + 9999) / 10000 * 10000; i < out_last && progress; i += 10000) {
+              std::cout << "Query " << i+1 << " out of " << num_queries << std::endl;
+            }
+            for (unsigned int s = 0; s < strands; s++) {
+              strand_files[s]->Write(batch_output[next_output_batch * strands + s]);
+              std::string().swap(batch_output[next_output_batch * strands + s]);
+            }
+            next_output_batch++;
+          }
+        }
+        if (bench) {
+          stats->output_seconds += WallSeconds() - output_start;
+        }
+      });
+      count_to(PHASE_STITCH);
+      stitch_pass_seconds += WallSeconds() - phase_start;
+      if (bench) {
+        AddLatencies(latency_counts, latencies.data(), chunk_queries);
       }
-      subread_file << std::endl;
     }
-    subread_file.close();
+    double close_start = WallSeconds();
+    count_from();
+    results_file.Close();
+    if (reverse_file != NULL) {
+      reverse_file->Close();
+      delete reverse_file;
+    }
+    count_to(PHASE_OUTPUT);
+    times.phase_seconds[PHASE_OUTPUT] += WallSeconds() - close_start;
+    times.total_seconds = WallSeconds() - trial_start;
+
+    if (bench) {
+      // Fetch, stitch and output share one pool pass, so its wall time is
+      // split between them in proportion to the workers' busy time
+      double fetch_busy = 0, stitch_busy = 0, output_busy = 0;
+      for (unsigned int t = 0; t < pool.num_threads(); t++) {
+        fetch_busy += thread_stats[t].fetch_seconds;
+        stitch_busy += thread_stats[t].stitch_seconds - thread_stats[t].fetch_seconds;
+        output_busy += thread_stats[t].output_seconds;
+      }
+      double busy = fetch_busy + stitch_busy + output_busy;
+      if (busy > 0) {
+        times.phase_seconds[PHASE_FETCH] += stitch_pass_seconds * fetch_busy / busy;
+        times.phase_seconds[PHASE_STITCH] += stitch_pass_seconds * stitch_busy / busy;
+        times.phase_seconds[PHASE_OUTPUT] += stitch_pass_seconds * output_busy / busy;
+      }
+      SummarizeLatencies(latency_counts, &times);
+      memcpy(times.counters, perf_phases, sizeof(perf_phases));
+      for (unsigned int t = 0; t < pool.num_threads(); t++) {
+        times.cache_lookups += thread_stats[t].num_cache_lookups;
+        times.cache_hits += thread_stats[t].num_cache_hits;
+      }
+      if (opts.numa != NUMA_OFF) {
+        times.node_lookups.assign(topology.nodes.size(), 0);
+        for (unsigned int t = 0; t < pool.num_threads(); t++) {
+          times.node_lookups[thread_node[t]] += num_it_accesses[t] / 2;
+        }
+      }
+      report.trials.push_back(times);
+    }
+  }
+  if (!bench) {
+    std::cout << "Interval table lookups took " << lookup_time.count() << " s (prefetch group "
+              << opts.prefetch_group << ")" << std::endl;
   }
 
-  // Deallocate query list
-  for (unsigned int i = 0; i < num_queries; i++) {
-    delete[] qlist.ptr[i];
+  for (unsigned int t = 0; t < pool.num_threads(); t++) {
+    delete scratch[t];
+  }
+  delete cache;
+  delete latency_counts;
+  if (argc == 7) {
+    subread_file.close();
+  }
+  if (bench) {
+    std::cout << "\n\nMerge kernel:\t" << MergeBackendName(opts.merge.backend) << std::endl;
+    PrintBenchSummary(&report);
   }
   delete[] qlist.ptr;
-  
-  // Read in Interval and Position Tables
-  std::cout << "Reading interval and position tables" << std::endl;
-  table interval_table;
-  table position_table;
-  ReadIntervalTable(argv[2], &interval_table);
-  ReadPositionTable(argv[3], &position_table);
-  
-  // Look up intervals for each subread
-  unsigned int num_it_accesses = 0;
-  unsigned int num_pt_accesses = 0;
-#ifndef _BENCHMARK
-  std::cout << "Performing interval table lookups" << std::endl;
-#endif
-#ifdef _BENCHMARK
-  std::cout << "Benchmarking (no more output until done)..." << std::endl;
-  clock_t start, mid, end;
-  start = clock();
-#endif
-  interval_list ilist;
-  ilist.num_queries = num_queries;
-  ilist.num_subreads_per_query = num_subreads_per_query;
-  ilist.ptr = new uint32_t**[num_queries];
-  for (unsigned int i = 0; i < num_queries; i++) {
-    ilist.ptr[i] = new uint32_t*[num_subreads_per_query];
-    for (unsigned int j = 0; j < num_subreads_per_query; j++) {
-      ilist.ptr[i][j] = new uint32_t[2];
-#ifndef _BENCHMARK
-      assert(srlist.ptr[i][j] < interval_table.length - 1);
-#endif
-      uint32_t srlist_lookup = srlist.ptr[i][j];
-      unsigned int* it = interval_table.ptr;
-      uint32_t lookup1 = it[srlist_lookup];
-      uint32_t lookup2 = it[srlist_lookup + 1];
-      ilist.ptr[i][j][0] = lookup1;
-      ilist.ptr[i][j][1] = lookup2;
-      num_it_accesses+=2;
-    }
-  }
-
-  // Look up positions for each subread
-#ifdef _BENCHMARK
-  mid = clock();
-#endif
-#ifndef _BENCHMARK
-  std::cout << "Performing position table lookups" << std::endl;
-  std::ofstream results_file;
-  results_file.open(argv[5]);
-  results_file << num_queries << std::endl;
-#endif
-  for (unsigned int i = 0; i < num_queries; i++) {
-#ifndef _BENCHMARK
-    if (i % 10000 == 0) {
-      std::cout << "Query " << i+1 << " out of " << num_queries << std::endl;
-    }
-#endif
-    uint32_t pt_start, pt_end;
-    pt_start = ilist.ptr[i][0][0];
-    pt_end = ilist.ptr[i][0][1];
-    std::vector<unsigned int>* prev_result = new std::vector<unsigned int>(pt_end - pt_start);
-    for (unsigned int j = 0; j < prev_result->size(); j++) {
-      unsigned int* pt = position_table.ptr;
-      unsigned int val = pt[j + pt_start];
-      num_pt_accesses++;
-      (*prev_result)[j] = val;
-    }
-
-    for (unsigned int j = 1; j < num_subreads_per_query; j++) {
-      pt_start = ilist.ptr[i][j][0];
-      pt_end = ilist.ptr[i][j][1];
-      std::vector<unsigned int> next_positions(pt_end - pt_start);
-      for (unsigned int k = 0; k < next_positions.size(); k++) {
-        unsigned int* pt = position_table.ptr;
-        unsigned int val = pt[k + pt_start];
-        num_pt_accesses++;
-        next_positions[k] = val;
-      }
-      
-      std::vector<unsigned int>* result = new std::vector<unsigned int>;
-      if (prev_result->size() == 0) {
-        break;
-      }
-      merge(prev_result, &next_positions, result, j*subread_length);
-      delete prev_result;
-      prev_result = result;      
-    }
-#ifndef _BENCHMARK
-    std::vector<unsigned int>::iterator it;
-    for (it = prev_result->begin(); it != prev_result->end(); it++) {
-      results_file << *it << ' ';
-    }
-    results_file << std::endl;
-#endif
-    delete prev_result;
-#ifdef _BENCHMARK
-	__asm__(""); //prevent loop from being optimized away by gcc when benchmarking (I hope!)
-				 // see http://stackoverflow.com/questions/7083482/how-to-prevent-compiler-optimization-on-a-small-piece-of-code
-#endif	
-  }
-#ifndef _BENCHMARK
-  results_file.close();
-#endif
-#ifdef _BENCHMARK
-   end = clock();
-   double time_read, time_sort, time_total;
-   time_read = ((double)(mid-start))/((double)CLOCKS_PER_SEC);
-   time_sort = ((double)(end-mid))/((double)CLOCKS_PER_SEC);
-   time_total = time_read +time_sort;
-   std::cout << "\n\nTotal CPU time (s):\t" << (time_total) << std::endl;
-   std::cout << "Queries per second:\t" << ((double)num_queries/(time_total)) << std::endl;
-   std::cout << "Seconds per query:\t" << ((time_total)/(double)num_queries) << std::endl;
-   std::cout << "Breakdown:\n\tLookup:\t" << time_read << " s\t " << (100.0*time_read/time_total) 
-			 << "%\n\tStitch:\t" << time_sort << " s\t " << (100.0*time_sort/time_total) << "%" << std::endl;
-#endif
-  std::cout << "Interval table accesses: " << num_it_accesses << std::endl;
-  std::cout << "Position table accesses: " << num_pt_accesses << std::endl;
+  delete[] srlist.ptr;
+  delete[] ilist.start;
+  delete[] ilist.end;
+  delete[] join_keys;
+  delete[] join_temp;
+  FreeTable(&interval_table);
+  FreeTable(&position_table);
+  if (compare_pages) {
+    FreeTable(&small_page_table);
+  }
+  for (size_t n = 0; n < replicas.size(); n++) {
+    FreeTable(&replicas[n]);
+  }
+  if (opts.verify_ref != NULL) {
+    FreeReference(&ref);
+  }
+  if (opts.contigs != NULL) {
+    FreeContigTable(&contigs);
+  }
+
+  unsigned long long total_it_accesses = 0;
+  stitch_stats total = stitch_stats();
+  for (unsigned int t = 0; t < pool.num_threads(); t++) {
+    total_it_accesses += num_it_accesses[t];
+    total.num_pt_accesses += thread_stats[t].num_pt_accesses;
+    total.num_pt_skipped += thread_stats[t].num_pt_skipped;
+    total.num_short_circuited += thread_stats[t].num_short_circuited;
+    total.num_allocations += thread_stats[t].num_allocations;
+    total.num_candidates += thread_stats[t].num_candidates;
+    total.num_verified += thread_stats[t].num_verified;
+    total.num_hits[0] += thread_stats[t].num_hits[0];
+    total.num_hits[1] += thread_stats[t].num_hits[1];
+    total.num_cache_lookups += thread_stats[t].num_cache_lookups;
+    total.num_cache_hits += thread_stats[t].num_cache_hits;
+    total.merges.num_linear += thread_stats[t].merges.num_linear;
+    total.merges.num_galloping += thread_stats[t].merges.num_galloping;
+    total.merges.num_kway += thread_stats[t].merges.num_kway;
+  }
+  std::cout << "Interval table accesses: " << total_it_accesses << std::endl;
+  std::cout << "Position table accesses: " << total.num_pt_accesses
+            << (opts.positions == POSITIONS_VARINT ? " (bytes)" : "") << std::endl;
+  std::cout << "Heap allocations while stitching: " << total.num_allocations << std::endl;
+  if (opts.cache_entries > 0) {
+    std::cout << "Result cache: " << total.num_cache_hits << " hits out of " << total.num_cache_lookups
+              << " lookups (" << opts.cache_entries << " entries)" << std::endl;
+  }
+  if (strands == 2) {
+    std::cout << "Hits: " << total.num_hits[0] << " forward, " << total.num_hits[1] << " reverse (written to "
+              << reverse_filename << ")" << std::endl;
+  }
+  if (opts.verify_ref != NULL) {
+    std::cout << "Candidates verified against reference: " << total.num_candidates << " (" << total.num_verified
+              << " matched, ";
+    if (sampled) {
+      std::cout << "position table step " << position_table.step << ")" << std::endl;
+    } else {
+      std::cout << "seeds " << opts.verify_seeds << ")" << std::endl;
+    }
+  }
+  if (opts.plan || opts.verify_ref != NULL) {
+    std::cout << "Position table accesses avoided by planner: " << total.num_pt_skipped
+              << " (" << total.num_short_circuited << " queries short-circuited on an empty interval)" << std::endl;
+  }
+  std::cout << "Merges: " << total.merges.num_linear << " linear, " << total.merges.num_galloping
+            << " galloping (ratio threshold " << opts.merge.gallop_ratio << ", kernel "
+            << MergeBackendName(opts.merge.backend) << "), " << total.merges.num_kway << " k-way" << std::endl;
+  if (perf) {
+    const int counted_phases[] = {PHASE_SPLIT, PHASE_LOOKUP, PHASE_STITCH, PHASE_OUTPUT};
+    for (int p : counted_phases) {
+      PrintPerfSample(BenchPhaseName(p), &perf_phases[p], &counters);
+    }
+    // Misses per table access tell a DRAM-latency bound lookup (LLC) apart
+    // from a TLB bound one (dTLB)
+    bool misses = counters.available(PERF_LLC_MISSES) && counters.available(PERF_DTLB_MISSES);
+    if (misses && total_it_accesses > 0) {
+      std::cout << "Lookup misses per interval table access: LLC "
+                << (double) perf_phases[PHASE_LOOKUP].count[PERF_LLC_MISSES] / total_it_accesses << ", dTLB "
+                << (double) perf_phases[PHASE_LOOKUP].count[PERF_DTLB_MISSES] / total_it_accesses << std::endl;
+    }
+    if (misses && total.num_pt_accesses > 0) {
+      std::cout << "Stitch misses per position table access: LLC "
+                << (double) perf_phases[PHASE_STITCH].count[PERF_LLC_MISSES] / total.num_pt_accesses << ", dTLB "
+                << (double) perf_phases[PHASE_STITCH].count[PERF_DTLB_MISSES] / total.num_pt_accesses << std::endl;
+    }
+  }
+
+  // The JSON report comes last, after every message
+  if (bench) {
+    std::cout.rdbuf(stdout_buffer);
+    WriteBenchJson(opts.bench_json, &report, &opts);
+  }
 }
@@ -0,0 +1,337 @@
+// Sorted position list intersection routines used to stitch subreads
+
+#include <stdint.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#include "merge.h"
+
+// Merges two sorted lists of positions, given a required offset (list2 - list1)
+unsigned int merge (const unsigned int* list1, unsigned int length1, const unsigned int* list2, unsigned int length2,
+                    unsigned int offset, unsigned int* result) {
+  unsigned int ptr1 = 0;
+  unsigned int ptr2 = 0;
+  unsigned int count = 0;
+  
+  while (ptr2 < length2 && list2[ptr2] < offset) {
+    ptr2++;
+  }
+  while ((ptr1 < length1) && (ptr2 < length2)) {
+    if (list1[ptr1] == list2[ptr2] - offset) {
+      result[count++] = list1[ptr1];
+      ptr1++;
+      ptr2++;
+    } else if (list1[ptr1] > (list2[ptr2] - offset)) {
+      ptr2++;
+    } else {
+      ptr1++;
+    }
+  }
+  return count;
+}
+
+/* Returns the index of the first element of list[begin, length) that is not
+ * less than target, or length if there is none. Probes begin+1, begin+2,
+ * begin+4, ... to bracket the answer, then binary searches the bracket.
+ */
+static unsigned int GallopLowerBound (const unsigned int* list, unsigned int begin, unsigned int length, uint64_t target) {
+  if (begin >= length || list[begin] >= target) {
+    return begin;
+  }
+  // Invariant: list[low] < target
+  unsigned int low = begin;
+  unsigned int step = 1;
+  while (step < length - begin && list[begin + step] < target) {
+    low = begin + step;
+    step <<= 1;
+  }
+  unsigned int high = (step < length - begin) ? begin + step : length;
+  while (high - low > 1) {
+    unsigned int mid = low + (high - low) / 2;
+    if (list[mid] < target) {
+      low = mid;
+    } else {
+      high = mid;
+    }
+  }
+  return high;
+}
+
+unsigned int GallopingMerge (const unsigned int* list1, unsigned int length1, const unsigned int* list2, unsigned int length2,
+                             unsigned int offset, unsigned int* result) {
+  unsigned int count = 0;
+  if (length1 <= length2) {
+    // Search the long list2 for position + offset of every entry in list1
+    unsigned int ptr2 = 0;
+    for (unsigned int ptr1 = 0; ptr1 < length1; ptr1++) {
+      uint64_t target = (uint64_t) list1[ptr1] + offset;
+      ptr2 = GallopLowerBound(list2, ptr2, length2, target);
+      if (ptr2 == length2) {
+        break;
+      }
+      if (list2[ptr2] == target) {
+        result[count++] = list1[ptr1];
+        ptr2++;
+      }
+    }
+  } else {
+    // Search the long list1 for position - offset of every entry in list2
+    unsigned int ptr1 = 0;
+    unsigned int ptr2 = GallopLowerBound(list2, 0, length2, offset);
+    for (; ptr2 < length2; ptr2++) {
+      uint64_t target = list2[ptr2] - offset;
+      ptr1 = GallopLowerBound(list1, ptr1, length1, target);
+      if (ptr1 == length1) {
+        break;
+      }
+      if (list1[ptr1] == target) {
+        result[count++] = list1[ptr1];
+        ptr1++;
+      }
+    }
+  }
+  return count;
+}
+
+unsigned int KWayMerge (kway_list* lists, unsigned int num_lists, unsigned int* result) {
+  unsigned int count = 0;
+  for (unsigned int i = 0; i < num_lists; i++) {
+    lists[i].cursor = 0;
+  }
+  // Seed the target with the first usable key of list 0
+  kway_list* list = &lists[0];
+  list->cursor = GallopLowerBound(list->positions, 0, list->length, list->offset);
+  if (list->cursor == list->length) {
+    return 0;
+  }
+  uint64_t target = list->positions[list->cursor] - list->offset;
+  unsigned int num_agreeing = 1;
+  unsigned int i = 0;
+  while (true) {
+    if (num_agreeing == num_lists) {
+      result[count++] = target;
+      // Step the list that completed the match past it and carry on
+      list = &lists[i];
+      list->cursor++;
+      if (list->cursor == list->length) {
+        return count;
+      }
+      target = list->positions[list->cursor] - list->offset;
+      num_agreeing = 1;
+      continue;
+    }
+    i = (i + 1 == num_lists) ? 0 : i + 1;
+    list = &lists[i];
+    list->cursor = GallopLowerBound(list->positions, list->cursor, list->length, target + list->offset);
+    if (list->cursor == list->length) {
+      return count;
+    }
+    uint64_t key = list->positions[list->cursor] - list->offset;
+    if (key == target) {
+      num_agreeing++;
+    } else {
+      target = key;
+      num_agreeing = 1;
+    }
+  }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// The SSE4.2 and AVX2 kernels below exist on x86 only; elsewhere every
+// backend resolves to the scalar merge.
+
+/* Finishes an intersection with the scalar two-pointer walk once fewer than
+ * a full block remains in either list. Returns the new output count.
+ */
+static unsigned int MergeTail (const unsigned int* list1, unsigned int length1, unsigned int ptr1,
+                               const unsigned int* list2, unsigned int length2, unsigned int ptr2,
+                               unsigned int offset, unsigned int* out, unsigned int count) {
+  while (ptr1 < length1 && ptr2 < length2) {
+    unsigned int val2 = list2[ptr2] - offset;
+    if (list1[ptr1] == val2) {
+      out[count++] = list1[ptr1];
+      ptr1++;
+      ptr2++;
+    } else if (list1[ptr1] > val2) {
+      ptr2++;
+    } else {
+      ptr1++;
+    }
+  }
+  return count;
+}
+
+// pshufb control that packs the 32-bit lanes selected by each 4-bit mask to
+// the front of an SSE register.
+static __m128i sse_compress_table[16];
+
+// vpermd indices that pack the 32-bit lanes selected by each 8-bit mask to
+// the front of an AVX2 register.
+static uint32_t avx2_compress_table[256][8];
+
+static bool InitCompressTables () {
+  for (unsigned int mask = 0; mask < 16; mask++) {
+    uint8_t bytes[16];
+    unsigned int lane = 0;
+    for (unsigned int i = 0; i < 4; i++) {
+      if (mask & (1 << i)) {
+        for (unsigned int b = 0; b < 4; b++) {
+          bytes[lane * 4 + b] = i * 4 + b;
+        }
+        lane++;
+      }
+    }
+    for (; lane < 4; lane++) {
+      for (unsigned int b = 0; b < 4; b++) {
+        bytes[lane * 4 + b] = 0x80;
+      }
+    }
+    sse_compress_table[mask] = _mm_loadu_si128((const __m128i*) bytes);
+  }
+  for (unsigned int mask = 0; mask < 256; mask++) {
+    unsigned int lane = 0;
+    for (unsigned int i = 0; i < 8; i++) {
+      if (mask & (1 << i)) {
+        avx2_compress_table[mask][lane++] = i;
+      }
+    }
+    for (; lane < 8; lane++) {
+      avx2_compress_table[mask][lane] = 0;
+    }
+  }
+  return true;
+}
+
+static bool compress_tables_ready = InitCompressTables();
+
+/* SSE4.2 block intersection. list2 must already be advanced past entries less
+ * than offset. Every block stores a full register, so out may be written up
+ * to 4 entries past the last match. Returns the number of matches.
+ */
+__attribute__((target("sse4.2")))
+static unsigned int IntersectSse42 (const unsigned int* list1, unsigned int length1,
+                                    const unsigned int* list2, unsigned int length2,
+                                    unsigned int offset, unsigned int* out) {
+  unsigned int ptr1 = 0;
+  unsigned int ptr2 = 0;
+  unsigned int count = 0;
+  __m128i offset_vec = _mm_set1_epi32(offset);
+  while (ptr1 + 4 <= length1 && ptr2 + 4 <= length2) {
+    __m128i a = _mm_loadu_si128((const __m128i*)(list1 + ptr1));
+    __m128i b = _mm_sub_epi32(_mm_loadu_si128((const __m128i*)(list2 + ptr2)), offset_vec);
+    __m128i match = _mm_cmpeq_epi32(a, b);
+    match = _mm_or_si128(match, _mm_cmpeq_epi32(a, _mm_shuffle_epi32(b, _MM_SHUFFLE(0, 3, 2, 1))));
+    match = _mm_or_si128(match, _mm_cmpeq_epi32(a, _mm_shuffle_epi32(b, _MM_SHUFFLE(1, 0, 3, 2))));
+    match = _mm_or_si128(match, _mm_cmpeq_epi32(a, _mm_shuffle_epi32(b, _MM_SHUFFLE(2, 1, 0, 3))));
+    unsigned int mask = _mm_movemask_ps(_mm_castsi128_ps(match));
+    _mm_storeu_si128((__m128i*)(out + count), _mm_shuffle_epi8(a, sse_compress_table[mask]));
+    count += __builtin_popcount(mask);
+
+    unsigned int max1 = list1[ptr1 + 3];
+    unsigned int max2 = list2[ptr2 + 3] - offset;
+    if (max1 <= max2) {
+      ptr1 += 4;
+    }
+    if (max2 <= max1) {
+      ptr2 += 4;
+    }
+  }
+  return MergeTail(list1, length1, ptr1, list2, length2, ptr2, offset, out, count);
+}
+
+/* AVX2 block intersection, the 8-wide counterpart of IntersectSse42(). out
+ * may be written up to 8 entries past the last match.
+ */
+__attribute__((target("avx2")))
+static unsigned int IntersectAvx2 (const unsigned int* list1, unsigned int length1,
+                                   const unsigned int* list2, unsigned int length2,
+                                   unsigned int offset, unsigned int* out) {
+  unsigned int ptr1 = 0;
+  unsigned int ptr2 = 0;
+  unsigned int count = 0;
+  __m256i offset_vec = _mm256_set1_epi32(offset);
+  __m256i rotate = _mm256_setr_epi32(1, 2, 3, 4, 5, 6, 7, 0);
+  while (ptr1 + 8 <= length1 && ptr2 + 8 <= length2) {
+    __m256i a = _mm256_loadu_si256((const __m256i*)(list1 + ptr1));
+    __m256i b = _mm256_sub_epi32(_mm256_loadu_si256((const __m256i*)(list2 + ptr2)), offset_vec);
+    __m256i match = _mm256_cmpeq_epi32(a, b);
+    for (unsigned int r = 1; r < 8; r++) {
+      b = _mm256_permutevar8x32_epi32(b, rotate);
+      match = _mm256_or_si256(match, _mm256_cmpeq_epi32(a, b));
+    }
+    unsigned int mask = _mm256_movemask_ps(_mm256_castsi256_ps(match));
+    __m256i pack = _mm256_loadu_si256((const __m256i*) avx2_compress_table[mask]);
+    _mm256_storeu_si256((__m256i*)(out + count), _mm256_permutevar8x32_epi32(a, pack));
+    count += __builtin_popcount(mask);
+
+    unsigned int max1 = list1[ptr1 + 7];
+    unsigned int max2 = list2[ptr2 + 7] - offset;
+    if (max1 <= max2) {
+      ptr1 += 8;
+    }
+    if (max2 <= max1) {
+      ptr2 += 8;
+    }
+  }
+  return MergeTail(list1, length1, ptr1, list2, length2, ptr2, offset, out, count);
+}
+#endif
+
+/* Resolves a requested backend to the kernel this CPU can actually run.
+ */
+static merge_backend ResolveBackend (merge_backend backend) {
+  if (backend == MERGE_SCALAR) {
+    return MERGE_SCALAR;
+  }
+#if defined(__x86_64__) || defined(__i386__)
+  if (backend != MERGE_SSE42 && __builtin_cpu_supports("avx2")) {
+    return MERGE_AVX2;
+  }
+  if (__builtin_cpu_supports("sse4.2")) {
+    return MERGE_SSE42;
+  }
+#endif
+  return MERGE_SCALAR;
+}
+
+const char* MergeBackendName (merge_backend backend) {
+  switch (ResolveBackend(backend)) {
+    case MERGE_AVX2 : return "avx2";
+    case MERGE_SSE42 : return "sse4.2";
+    default : return "scalar";
+  }
+}
+
+unsigned int SimdMerge (const unsigned int* list1, unsigned int length1, const unsigned int* list2, unsigned int length2,
+                        unsigned int offset, unsigned int* result, merge_backend backend) {
+#if defined(__x86_64__) || defined(__i386__)
+  merge_backend kernel = ResolveBackend(backend);
+  if (kernel != MERGE_SCALAR) {
+    unsigned int skip = 0;
+    while (skip < length2 && list2[skip] < offset) {
+      skip++;
+    }
+    if (kernel == MERGE_AVX2) {
+      return IntersectAvx2(list1, length1, list2 + skip, length2 - skip, offset, result);
+    }
+    return IntersectSse42(list1, length1, list2 + skip, length2 - skip, offset, result);
+  }
+#endif
+  return merge(list1, length1, list2, length2, offset, result);
+}
+
+unsigned int AdaptiveMerge (const unsigned int* list1, unsigned int length1, const unsigned int* list2, unsigned int length2,
+                            unsigned int offset, unsigned int* result, merge_config* config, merge_stats* stats) {
+  uint64_t shorter = length1 < length2 ? length1 : length2;
+  uint64_t longer = length1 < length2 ? length2 : length1;
+  if (config->gallop_ratio != 0 && longer >= shorter * config->gallop_ratio) {
+    stats->num_galloping++;
+    return GallopingMerge(list1, length1, list2, length2, offset, result);
+  } else if (config->backend != MERGE_SCALAR) {
+    stats->num_linear++;
+    return SimdMerge(list1, length1, list2, length2, offset, result, config->backend);
+  } else {
+    stats->num_linear++;
+    return merge(list1, length1, list2, length2, offset, result);
+  }
+}
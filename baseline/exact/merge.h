@@ -0,0 +1,79 @@
+#ifndef _merge_h
+#define _merge_h
+
+// Kernel used for merges that do not gallop. MERGE_SIMD picks the widest
+// instruction set the CPU supports at run time.
+enum merge_backend {
+  MERGE_SCALAR,
+  MERGE_SIMD,
+  MERGE_SSE42,
+  MERGE_AVX2
+};
+
+struct merge_config {
+  unsigned int gallop_ratio;
+  merge_backend backend;
+};
+
+// Counts how often each intersection strategy was chosen.
+struct merge_stats {
+  unsigned long long num_linear;
+  unsigned long long num_galloping;
+  unsigned long long num_kway;
+};
+
+// One input of KWayMerge(): a sorted position list whose entries lie offset
+// positions ahead of the positions being intersected. cursor is working
+// state owned by KWayMerge().
+struct kway_list {
+  const unsigned int* positions;
+  unsigned int length;
+  unsigned int offset;
+  unsigned int cursor;
+};
+
+// All routines below intersect two sorted position lists where list2 is
+// offset positions ahead of list1, writing the matching list1 positions to
+// result in order and returning how many there were. result must have room
+// for min(length1, length2) + MERGE_RESULT_PADDING entries; the SIMD kernels
+// store whole registers and may write past the last match.
+#define MERGE_RESULT_PADDING 8
+
+// Merges two sorted lists of positions, given a required offset (list2 - list1)
+unsigned int merge (const unsigned int* list1, unsigned int length1, const unsigned int* list2, unsigned int length2,
+                    unsigned int offset, unsigned int* result);
+
+// Produces the same result as merge(), but walks the shorter list and finds
+// each partner in the longer list by exponential then binary search, so the
+// cost is O(short * log(long / short)) rather than O(short + long).
+unsigned int GallopingMerge (const unsigned int* list1, unsigned int length1, const unsigned int* list2, unsigned int length2,
+                             unsigned int offset, unsigned int* result);
+
+// Produces the same result as merge() with a block-compare kernel: blocks of
+// 4 (SSE4.2) or 8 (AVX2) positions from each list are compared all-against-all
+// after subtracting offset from list2 in-register, and the matching list1
+// lanes are packed into result with a shuffle. backend must be one of the
+// SIMD values; it falls back to narrower kernels, then to merge(), when the
+// CPU lacks the requested instructions.
+unsigned int SimdMerge (const unsigned int* list1, unsigned int length1, const unsigned int* list2, unsigned int length2,
+                        unsigned int offset, unsigned int* result, merge_backend backend);
+
+// Returns the name of the kernel that the given backend resolves to on this
+// CPU, e.g. "avx2" for MERGE_SIMD on a machine with AVX2.
+const char* MergeBackendName (merge_backend backend);
+
+// Intersects all num_lists lists in a single pass, writing every position p
+// for which each list contains p + offset to result in order, and returns
+// how many there were. This is a leapfrog join, the software counterpart of
+// the hardware Stitcher: the lists take turns seeking (by galloping) to the
+// largest key seen so far until all agree, so no intermediate lists are
+// materialized. result must have room for the length of the shortest list.
+unsigned int KWayMerge (kway_list* lists, unsigned int num_lists, unsigned int* result);
+
+// Uses GallopingMerge() when one list is at least config->gallop_ratio times
+// as long as the other and the configured linear kernel otherwise. A ratio of
+// 0 never gallops.
+unsigned int AdaptiveMerge (const unsigned int* list1, unsigned int length1, const unsigned int* list2, unsigned int length2,
+                            unsigned int offset, unsigned int* result, merge_config* config, merge_stats* stats);
+
+#endif
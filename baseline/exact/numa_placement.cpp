@@ -0,0 +1,102 @@
+// Places tables and pins workers across NUMA nodes for --numa
+
+#include <fstream>
+#include <string>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include "numa_placement.h"
+
+// Nodes representable in the memory policy masks passed to the kernel
+#define MAX_NUMA_NODES 1024
+
+static const char* kPolicyNames[] = {"off", "interleave", "replicate"};
+
+const char* NumaPolicyName (numa_policy policy) {
+  return kPolicyNames[policy];
+}
+
+/* Parses a sysfs list such as "0-3,8,10-11" into its members. Returns false
+ * if the file cannot be read.
+ */
+static bool ReadSysfsList (const std::string& filename, std::vector<int>* members) {
+  std::ifstream file(filename.c_str());
+  std::string list;
+  if (!file.is_open() || !std::getline(file, list)) {
+    return false;
+  }
+  const char* p = list.c_str();
+  while (*p != '\0') {
+    char* end;
+    long first = strtol(p, &end, 10);
+    if (end == p) {
+      break;
+    }
+    long last = first;
+    p = end;
+    if (*p == '-') {
+      last = strtol(p + 1, &end, 10);
+      p = end;
+    }
+    for (long m = first; m <= last; m++) {
+      members->push_back((int) m);
+    }
+    if (*p == ',') {
+      p++;
+    }
+  }
+  return true;
+}
+
+bool ReadNumaTopology (numa_topology* topology) {
+  topology->nodes.clear();
+  topology->cpus.clear();
+  std::vector<int> online;
+  if (ReadSysfsList("/sys/devices/system/node/online", &online)) {
+    for (int node : online) {
+      std::vector<int> cpus;
+      std::string cpulist = "/sys/devices/system/node/node" + std::to_string(node) + "/cpulist";
+      if (node < MAX_NUMA_NODES && ReadSysfsList(cpulist, &cpus) && !cpus.empty()) {
+        topology->nodes.push_back(node);
+        topology->cpus.push_back(cpus);
+      }
+    }
+  }
+  if (!topology->nodes.empty()) {
+    return true;
+  }
+  // No NUMA information; treat the machine as a single node
+  std::vector<int> cpus;
+  long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  for (long c = 0; c < num_cpus; c++) {
+    cpus.push_back((int) c);
+  }
+  topology->nodes.push_back(0);
+  topology->cpus.push_back(cpus);
+  return false;
+}
+
+/* Calls set_mempolicy() with a mask of the given nodes.
+ */
+static bool SetMemoryPolicy (int mode, const std::vector<int>& nodes) {
+  const int bits_per_word = 8 * sizeof(unsigned long);
+  unsigned long mask[MAX_NUMA_NODES / (8 * sizeof(unsigned long))] = {0};
+  for (int node : nodes) {
+    mask[node / bits_per_word] |= 1UL << (node % bits_per_word);
+  }
+  // maxnode is one more than the number of bits the kernel should read
+  return syscall(SYS_set_mempolicy, mode, mask, MAX_NUMA_NODES + 1) == 0;
+}
+
+bool InterleaveMemory (const numa_topology* topology) {
+  return SetMemoryPolicy(MPOL_INTERLEAVE, topology->nodes);
+}
+
+bool BindMemory (int node) {
+  return SetMemoryPolicy(MPOL_BIND, std::vector<int>(1, node));
+}
+
+void ResetMemoryPolicy () {
+  syscall(SYS_set_mempolicy, MPOL_DEFAULT, NULL, 0);
+}
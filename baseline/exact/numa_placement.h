@@ -0,0 +1,43 @@
+#ifndef _numa_placement_h
+#define _numa_placement_h
+
+#include <vector>
+#include "table_io.h"
+
+// Table placement on multi-socket hosts, chosen with --numa.
+//
+// NUMA_INTERLEAVE spreads the pages of both tables round-robin over every
+// node, so remote traffic is shared evenly between the memory controllers.
+// NUMA_REPLICATE keeps one copy of the (read-only) interval table on each
+// node and has every worker look up in the copy next to it; the position
+// table is interleaved. Either way worker threads are pinned to the CPUs of
+// a node.
+enum numa_policy {
+  NUMA_OFF,
+  NUMA_INTERLEAVE,
+  NUMA_REPLICATE
+};
+
+// Returns the name of a policy as used by --numa.
+const char* NumaPolicyName (numa_policy policy);
+
+// Nodes that have CPUs, and the CPUs of each, as listed in sysfs.
+struct numa_topology {
+  std::vector<int> nodes;
+  std::vector<std::vector<int> > cpus;
+};
+
+// Reads the node layout from /sys/devices/system/node. Returns false, with
+// a single node holding every online CPU, if it cannot be read.
+bool ReadNumaTopology (numa_topology* topology);
+
+// Sets the memory policy of the calling thread, which decides where the
+// pages it touches first are placed: interleaved over every node of the
+// topology, or all on one node. Returns false if the kernel refuses.
+bool InterleaveMemory (const numa_topology* topology);
+bool BindMemory (int node);
+
+// Returns the calling thread to the default (local) memory policy.
+void ResetMemoryPolicy ();
+
+#endif
@@ -0,0 +1,327 @@
+// Parses the optional "--name value" flags accepted by the baseline
+
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <climits>
+#include <sys/mman.h>
+#include "options.h"
+
+/* Parses a strictly positive integer option value. Returns false if the
+ * value is missing, malformed, zero or too large for an unsigned int.
+ */
+static bool ParseCount (const char* name, const char* value, unsigned int* count) {
+  if (value == NULL) {
+    std::cout << "Missing value for " << name << std::endl;
+    return false;
+  }
+  char* end;
+  errno = 0;
+  long parsed = strtol(value, &end, 10);
+  if (*end != '\0' || parsed <= 0 || errno == ERANGE || (unsigned long) parsed > UINT_MAX) {
+    std::cout << "Invalid value for " << name << ": " << value << std::endl;
+    return false;
+  }
+  *count = (unsigned int) parsed;
+  return true;
+}
+
+/* Maps an --madvise mode name to the matching madvise() constant. Returns
+ * false if the name is not recognized.
+ */
+static bool ParseAdvice (const char* value, int* advice) {
+  if (value == NULL) {
+    std::cout << "Missing value for --madvise" << std::endl;
+    return false;
+  }
+  if (strcmp(value, "normal") == 0) {
+    *advice = MADV_NORMAL;
+  } else if (strcmp(value, "random") == 0) {
+    *advice = MADV_RANDOM;
+  } else if (strcmp(value, "sequential") == 0) {
+    *advice = MADV_SEQUENTIAL;
+  } else if (strcmp(value, "willneed") == 0) {
+    *advice = MADV_WILLNEED;
+  } else {
+    std::cout << "Invalid value for --madvise: " << value << std::endl;
+    return false;
+  }
+  return true;
+}
+
+/* Maps a --hugepages mode name to its table_pages backing. Returns false if
+ * the name is not recognized.
+ */
+static bool ParsePages (const char* value, table_pages* pages) {
+  if (value == NULL) {
+    std::cout << "Missing value for --hugepages" << std::endl;
+    return false;
+  }
+  for (int p = PAGES_DEFAULT; p <= PAGES_1G; p++) {
+    if (strcmp(value, TablePagesName((table_pages) p)) == 0) {
+      *pages = (table_pages) p;
+      return true;
+    }
+  }
+  std::cout << "Invalid value for --hugepages: " << value << std::endl;
+  return false;
+}
+
+/* Maps a --numa policy name to its numa_policy. Returns false if the name
+ * is not recognized.
+ */
+static bool ParseNumaPolicy (const char* value, numa_policy* policy) {
+  if (value == NULL) {
+    std::cout << "Missing value for --numa" << std::endl;
+    return false;
+  }
+  for (int p = NUMA_OFF; p <= NUMA_REPLICATE; p++) {
+    if (strcmp(value, NumaPolicyName((numa_policy) p)) == 0) {
+      *policy = (numa_policy) p;
+      return true;
+    }
+  }
+  std::cout << "Invalid value for --numa: " << value << std::endl;
+  return false;
+}
+
+/* Maps an --index backend name to its seed_index. Returns false if the name
+ * is not recognized.
+ */
+static bool ParseIndex (const char* value, seed_index* index) {
+  if (value == NULL) {
+    std::cout << "Missing value for --index" << std::endl;
+    return false;
+  }
+  for (int x = INDEX_DENSE; x <= INDEX_HASH; x++) {
+    if (strcmp(value, SeedIndexName((seed_index) x)) == 0) {
+      *index = (seed_index) x;
+      return true;
+    }
+  }
+  std::cout << "Invalid value for --index: " << value << std::endl;
+  return false;
+}
+
+/* Maps a --positions encoding name to its position_format. Returns false if
+ * the name is not recognized.
+ */
+static bool ParsePositionFormat (const char* value, position_format* format) {
+  if (value == NULL) {
+    std::cout << "Missing value for --positions" << std::endl;
+    return false;
+  }
+  for (int f = POSITIONS_RAW; f <= POSITIONS_ELIAS_FANO; f++) {
+    if (strcmp(value, PositionFormatName((position_format) f)) == 0) {
+      *format = (position_format) f;
+      return true;
+    }
+  }
+  std::cout << "Invalid value for --positions: " << value << std::endl;
+  return false;
+}
+
+/* Maps a --merge kernel name to its merge_backend. Returns false if the name
+ * is not recognized.
+ */
+static bool ParseBackend (const char* value, merge_backend* backend) {
+  if (value == NULL) {
+    std::cout << "Missing value for --merge" << std::endl;
+    return false;
+  }
+  if (strcmp(value, "scalar") == 0) {
+    *backend = MERGE_SCALAR;
+  } else if (strcmp(value, "simd") == 0) {
+    *backend = MERGE_SIMD;
+  } else if (strcmp(value, "sse4.2") == 0) {
+    *backend = MERGE_SSE42;
+  } else if (strcmp(value, "avx2") == 0) {
+    *backend = MERGE_AVX2;
+  } else {
+    std::cout << "Invalid value for --merge: " << value << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool ParseOptions (int* argc, char** argv, options* opts) {
+  opts->num_threads = 1;
+  opts->batch_size = 256;
+  opts->use_mmap = false;
+  opts->mmap_populate = false;
+  opts->mmap_advice = MADV_NORMAL;
+  opts->huge_pages = PAGES_DEFAULT;
+  opts->numa = NUMA_OFF;
+  opts->index = INDEX_DENSE;
+  opts->positions = POSITIONS_RAW;
+  opts->merge.gallop_ratio = 32;
+  opts->merge.backend = MERGE_SCALAR;
+  opts->plan = false;
+  opts->kway = false;
+  opts->sort_join = false;
+  opts->prefetch_group = 0;
+  opts->chunk_size = 0;
+  opts->output_format = RESULTS_TEXT;
+  opts->output_buffer_size = 4 << 20;
+  opts->contigs = NULL;
+  opts->verify_ref = NULL;
+  opts->verify_seeds = 1;
+  opts->both_strands = false;
+  opts->cache_entries = 0;
+  opts->bench_trials = 0;
+  opts->bench_warmup = 1;
+  opts->bench_json = NULL;
+  opts->perf = false;
+
+  int num_positional = 1;
+  for (int i = 1; i < *argc; i++) {
+    const char* arg = argv[i];
+    const char* value = (i + 1 < *argc) ? argv[i + 1] : NULL;
+    if (strncmp(arg, "--", 2) != 0) {
+      argv[num_positional++] = argv[i];
+    } else if (strcmp(arg, "--threads") == 0) {
+      if (!ParseCount(arg, value, &opts->num_threads)) return false;
+      i++;
+    } else if (strcmp(arg, "--batch") == 0) {
+      if (!ParseCount(arg, value, &opts->batch_size)) return false;
+      i++;
+    } else if (strcmp(arg, "--mmap") == 0) {
+      opts->use_mmap = true;
+    } else if (strcmp(arg, "--populate") == 0) {
+      opts->mmap_populate = true;
+    } else if (strcmp(arg, "--madvise") == 0) {
+      if (!ParseAdvice(value, &opts->mmap_advice)) return false;
+      i++;
+    } else if (strcmp(arg, "--hugepages") == 0) {
+      if (!ParsePages(value, &opts->huge_pages)) return false;
+      i++;
+    } else if (strcmp(arg, "--numa") == 0) {
+      if (!ParseNumaPolicy(value, &opts->numa)) return false;
+      i++;
+    } else if (strcmp(arg, "--index") == 0) {
+      if (!ParseIndex(value, &opts->index)) return false;
+      i++;
+    } else if (strcmp(arg, "--positions") == 0) {
+      if (!ParsePositionFormat(value, &opts->positions)) return false;
+      i++;
+    } else if (strcmp(arg, "--gallop-ratio") == 0) {
+      // 0 is meaningful here: it disables galloping
+      if (value != NULL && strcmp(value, "0") == 0) {
+        opts->merge.gallop_ratio = 0;
+      } else if (!ParseCount(arg, value, &opts->merge.gallop_ratio)) {
+        return false;
+      }
+      i++;
+    } else if (strcmp(arg, "--plan") == 0) {
+      opts->plan = true;
+    } else if (strcmp(arg, "--kway") == 0) {
+      opts->kway = true;
+    } else if (strcmp(arg, "--sort-join") == 0) {
+      opts->sort_join = true;
+    } else if (strcmp(arg, "--group") == 0) {
+      if (!ParseCount(arg, value, &opts->prefetch_group)) return false;
+      i++;
+    } else if (strcmp(arg, "--chunk") == 0) {
+      if (!ParseCount(arg, value, &opts->chunk_size)) return false;
+      i++;
+    } else if (strcmp(arg, "--output") == 0) {
+      if (value != NULL && strcmp(value, "text") == 0) {
+        opts->output_format = RESULTS_TEXT;
+      } else if (value != NULL && strcmp(value, "binary") == 0) {
+        opts->output_format = RESULTS_BINARY;
+      } else {
+        std::cout << "Invalid value for --output" << std::endl;
+        return false;
+      }
+      i++;
+    } else if (strcmp(arg, "--output-buffer") == 0) {
+      unsigned int kilobytes;
+      if (!ParseCount(arg, value, &kilobytes)) return false;
+      opts->output_buffer_size = (size_t) kilobytes << 10;
+      i++;
+    } else if (strcmp(arg, "--contigs") == 0) {
+      if (value == NULL) {
+        std::cout << "Missing value for --contigs" << std::endl;
+        return false;
+      }
+      opts->contigs = argv[++i];
+    } else if (strcmp(arg, "--verify") == 0) {
+      if (value == NULL) {
+        std::cout << "Missing value for --verify" << std::endl;
+        return false;
+      }
+      opts->verify_ref = argv[++i];
+    } else if (strcmp(arg, "--verify-seeds") == 0) {
+      if (!ParseCount(arg, value, &opts->verify_seeds)) return false;
+      i++;
+    } else if (strcmp(arg, "--both-strands") == 0) {
+      opts->both_strands = true;
+    } else if (strcmp(arg, "--cache") == 0) {
+      if (!ParseCount(arg, value, &opts->cache_entries)) return false;
+      i++;
+    } else if (strcmp(arg, "--no-cache") == 0) {
+      opts->cache_entries = 0;
+    } else if (strcmp(arg, "--bench") == 0) {
+      if (!ParseCount(arg, value, &opts->bench_trials)) return false;
+      i++;
+    } else if (strcmp(arg, "--warmup") == 0) {
+      // 0 is meaningful here: it times the very first pass
+      if (value != NULL && strcmp(value, "0") == 0) {
+        opts->bench_warmup = 0;
+      } else if (!ParseCount(arg, value, &opts->bench_warmup)) {
+        return false;
+      }
+      i++;
+    } else if (strcmp(arg, "--bench-json") == 0) {
+      if (value == NULL) {
+        std::cout << "Missing value for --bench-json" << std::endl;
+        return false;
+      }
+      opts->bench_json = argv[++i];
+    } else if (strcmp(arg, "--perf") == 0) {
+      opts->perf = true;
+    } else if (strcmp(arg, "--merge") == 0) {
+      if (!ParseBackend(value, &opts->merge.backend)) return false;
+      i++;
+    } else {
+      std::cout << "Unknown option " << arg << std::endl;
+      return false;
+    }
+  }
+  argv[num_positional] = NULL;
+  *argc = num_positional;
+  return true;
+}
+
+void PrintOptionsUsage () {
+  std::cout << "Options:" << std::endl;
+  std::cout << "  --threads N   Align queries on N worker threads (default 1)" << std::endl;
+  std::cout << "  --batch N     Queries per work-stealing batch (default 256)" << std::endl;
+  std::cout << "  --mmap        Map the tables read-only instead of copying them into memory" << std::endl;
+  std::cout << "  --populate    With --mmap, prefault the whole mapping at load time" << std::endl;
+  std::cout << "  --madvise M   With --mmap, advise the kernel: normal, random, sequential, willneed" << std::endl;
+  std::cout << "  --hugepages P Without --mmap, back the tables with huge pages: thp, 2m, 1g, off (default off)" << std::endl;
+  std::cout << "  --numa P      Pin workers to nodes and place tables: interleave, replicate (interval table per node), off (default off)" << std::endl;
+  std::cout << "  --index I     Interval table format: dense (gen_tables, k <= 15) or hash (gen_hash_tables, k <= 32) (default dense)" << std::endl;
+  std::cout << "  --positions F Position table format: raw (gen_tables), varint (gen_tables_compressed type 1), packed (gen_tables --packed) or elias-fano (gen_tables --elias-fano) (default raw)" << std::endl;
+  std::cout << "  --gallop-ratio R  Gallop when one list is R times longer than the other, 0 = never (default 32)" << std::endl;
+  std::cout << "  --merge K     Linear merge kernel: scalar, simd (best available), sse4.2, avx2 (default scalar)" << std::endl;
+  std::cout << "  --plan        Stitch each query's subreads shortest interval first, skipping queries with an empty interval" << std::endl;
+  std::cout << "  --kway        Intersect all of a query's subread lists in one leapfrog pass instead of pairwise" << std::endl;
+  std::cout << "  --sort-join   Radix-sort each chunk's subreads and sweep the tables in address order (size with --chunk)" << std::endl;
+  std::cout << "  --group G     Prefetch table entries G queries ahead during lookups (default off)" << std::endl;
+  std::cout << "  --chunk N     Stream the query file N queries at a time with bounded memory (e.g. 65536)" << std::endl;
+  std::cout << "  --output F    Results file format: text or binary (default text)" << std::endl;
+  std::cout << "  --output-buffer K  Results write buffer in KB (default 4096)" << std::endl;
+  std::cout << "  --contigs F   Report hits as contig:offset using the contig table F of a joined reference (join_ref_seqs)" << std::endl;
+  std::cout << "  --verify REF  Seed-and-verify: stitch only the rarest subreads, then check candidates against the packed reference" << std::endl;
+  std::cout << "  --verify-seeds N  With --verify, number of rarest subreads to stitch (default 1)" << std::endl;
+  std::cout << "  --both-strands  Also align the reverse complement of each query in the same pass; its hits go to <Output Filename>.rc" << std::endl;
+  std::cout << "  --cache N     Serve duplicate reads, interval lookups included, from a cache of N stitched results (default off, about 4 KB each)" << std::endl;
+  std::cout << "  --no-cache    Stitch every read, even exact duplicates (the default)" << std::endl;
+  std::cout << "  --bench N     Time N passes over the queries per phase on the wall clock and report JSON on standard output, other messages going to standard error" << std::endl;
+  std::cout << "  --warmup N    With --bench, untimed passes before the trials (default 1)" << std::endl;
+  std::cout << "  --bench-json F  With --bench, write the JSON report to F instead of standard output, which keeps the messages" << std::endl;
+  std::cout << "  --perf        Count cycles, instructions, LLC, dTLB and branch misses per phase" << std::endl;
+}
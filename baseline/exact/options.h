@@ -0,0 +1,50 @@
+#ifndef _options_h
+#define _options_h
+
+#include <stddef.h>
+#include "merge.h"
+#include "results_writer.h"
+#include "table_io.h"
+#include "numa_placement.h"
+#include "seed_hash.h"
+
+// Run-time options for the baseline, set from "--name value" flags that may
+// appear anywhere on the command line ahead of or between positional args.
+struct options {
+  unsigned int num_threads;   // --threads: worker threads (1 = serial)
+  unsigned int batch_size;    // --batch: queries per work-stealing batch
+  bool use_mmap;              // --mmap: map tables instead of reading them
+  bool mmap_populate;         // --populate: prefault mapped tables
+  int mmap_advice;            // --madvise: madvise() hint for mapped tables
+  table_pages huge_pages;     // --hugepages: page backing for tables read into memory
+  numa_policy numa;           // --numa: table placement across memory nodes
+  seed_index index;           // --index: dense interval table or hash seed index
+  position_format positions;  // --positions: raw or compressed position table
+  merge_config merge;         // --gallop-ratio, --merge: intersection choice
+  bool plan;                  // --plan: stitch subreads shortest interval first
+  bool kway;                  // --kway: intersect all subread lists in one pass
+  bool sort_join;             // --sort-join: look up each chunk's subreads in sorted order
+  unsigned int prefetch_group; // --group: queries of table lookups kept in flight
+  unsigned int chunk_size;    // --chunk: queries read and aligned at a time (0 = all)
+  results_format output_format; // --output: text or binary results file
+  size_t output_buffer_size;  // --output-buffer: bytes buffered before each write
+  char* contigs;              // --contigs: contig table of a joined reference
+  char* verify_ref;           // --verify: packed reference for seed-and-verify
+  unsigned int verify_seeds;  // --verify-seeds: rarest subreads to stitch first
+  bool both_strands;          // --both-strands: also align each query's reverse complement
+  unsigned int cache_entries; // --cache: duplicate-read result cache size (0 = --no-cache)
+  unsigned int bench_trials;  // --bench: timed passes over the queries (0 = off)
+  unsigned int bench_warmup;  // --warmup: untimed passes before the trials
+  char* bench_json;           // --bench-json: JSON report file (default stdout)
+  bool perf;                  // --perf: count hardware events per phase
+};
+
+// Fills opts with defaults, then consumes every recognized flag from argv,
+// compacting the remaining positional arguments to the front and updating
+// argc. Returns false (after printing a message) on a malformed flag.
+bool ParseOptions (int* argc, char** argv, options* opts);
+
+// Prints the option summary that follows the positional usage line.
+void PrintOptionsUsage ();
+
+#endif
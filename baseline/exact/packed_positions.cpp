@@ -0,0 +1,20 @@
+// Unpacks bit-packed position lists for --positions packed
+
+#include "packed_positions.h"
+
+unsigned int UnpackPositions (const unsigned char* packed, unsigned int bits, uint32_t first, uint32_t last,
+                              unsigned int offset, unsigned int* out) {
+  uint64_t mask = (1ULL << bits) - 1;
+  uint64_t bit = (uint64_t) first * bits;
+  unsigned int count = 0;
+  for (uint32_t k = first; k < last; k++, bit += bits) {
+    // bits <= 32 and the shift is below 8, so one 8-byte load always holds
+    // the whole position
+    uint64_t word;
+    memcpy(&word, packed + (bit >> 3), sizeof(word));
+    unsigned int val = (unsigned int) ((word >> (bit & 7)) & mask);
+    out[count] = val - offset;
+    count += (val >= offset);
+  }
+  return count;
+}
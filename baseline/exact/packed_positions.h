@@ -0,0 +1,33 @@
+#ifndef _packed_positions_h
+#define _packed_positions_h
+
+#include <stdint.h>
+#include <string.h>
+
+// Position tables written by gen_tables --packed, read with --positions
+// packed. Every position takes the same number of bits, just enough for the
+// largest position in the table (ceil(log2(N - k + 1)), at most 32), and
+// position k of the table occupies bits [k * bits, (k + 1) * bits) of the
+// stream, least significant bit first. The interval table is unchanged and
+// still holds position indices. The stream is followed by at least
+// PACKED_POSITION_PADDING zero bytes, up to a whole number of 32-bit words,
+// so that every position can be read with one unaligned 8-byte load.
+#define PACKED_POSITION_PADDING 8
+
+// Returns position k of a packed stream with the given bits per position.
+inline unsigned int PackedPosition (const unsigned char* packed, unsigned int bits, uint64_t k) {
+  uint64_t bit = k * bits;
+  uint64_t word;
+  memcpy(&word, packed + (bit >> 3), sizeof(word));
+  return (unsigned int) ((word >> (bit & 7)) & ((1ULL << bits) - 1));
+}
+
+// Unpacks positions [first, last) of a packed stream, writing p - offset for
+// every position p >= offset to out and returning how many were written.
+// The loop has no data-dependent branches: every position costs one load,
+// shift and mask, and positions below offset are dropped by not advancing
+// the output index. out must have room for last - first + 1 entries.
+unsigned int UnpackPositions (const unsigned char* packed, unsigned int bits, uint32_t first, uint32_t last,
+                              unsigned int offset, unsigned int* out);
+
+#endif
@@ -0,0 +1,119 @@
+// Reads hardware performance counters for --perf through perf_event_open()
+
+#include <cerrno>
+#include <stdint.h>
+#include <cstring>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "perf_counters.h"
+
+static const char* kEventNames[NUM_PERF_EVENTS] = {
+  "cycles", "instructions", "llc_misses", "dtlb_misses", "branch_misses"
+};
+
+const char* PerfEventName (int event) {
+  return kEventNames[event];
+}
+
+/* Fills in the type and config of a --perf event.
+ */
+static void DescribeEvent (int event, perf_event_attr* attr) {
+  switch (event) {
+    case PERF_CYCLES:
+      attr->type = PERF_TYPE_HARDWARE;
+      attr->config = PERF_COUNT_HW_CPU_CYCLES;
+      break;
+    case PERF_INSTRUCTIONS:
+      attr->type = PERF_TYPE_HARDWARE;
+      attr->config = PERF_COUNT_HW_INSTRUCTIONS;
+      break;
+    case PERF_LLC_MISSES:
+      attr->type = PERF_TYPE_HW_CACHE;
+      attr->config = PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                     (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+      break;
+    case PERF_DTLB_MISSES:
+      attr->type = PERF_TYPE_HW_CACHE;
+      attr->config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                     (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+      break;
+    case PERF_BRANCH_MISSES:
+      attr->type = PERF_TYPE_HARDWARE;
+      attr->config = PERF_COUNT_HW_BRANCH_MISSES;
+      break;
+  }
+}
+
+PerfCounters::PerfCounters() {
+  for (int e = 0; e < NUM_PERF_EVENTS; e++) {
+    fds_[e] = -1;
+  }
+  errno_ = 0;
+}
+
+PerfCounters::~PerfCounters() {
+  for (int e = 0; e < NUM_PERF_EVENTS; e++) {
+    if (fds_[e] >= 0) {
+      close(fds_[e]);
+    }
+  }
+}
+
+bool PerfCounters::Open() {
+  bool any = false;
+  for (int e = 0; e < NUM_PERF_EVENTS; e++) {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    DescribeEvent(e, &attr);
+    // User space only, so the default perf_event_paranoid setting allows it.
+    // Events are opened separately rather than as a group because inherited
+    // counters cannot be read as a group.
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.inherit = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    int fd = (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    if (fd < 0) {
+      errno_ = errno;
+      continue;
+    }
+    fds_[e] = fd;
+    any = true;
+  }
+  return any;
+}
+
+void PerfCounters::Read(perf_sample* sample) {
+  for (int e = 0; e < NUM_PERF_EVENTS; e++) {
+    sample->count[e] = 0;
+    uint64_t values[3];
+    if (fds_[e] < 0 || read(fds_[e], values, sizeof(values)) != (ssize_t) sizeof(values)) {
+      continue;
+    }
+    // values = {count, time enabled, time running}
+    if (values[2] > 0 && values[2] < values[1]) {
+      values[0] = (uint64_t) ((double) values[0] * values[1] / values[2]);
+    }
+    sample->count[e] = values[0];
+  }
+}
+
+bool PerfCounters::available(int event) {
+  return fds_[event] >= 0;
+}
+
+const char* PerfCounters::error() {
+  return strerror(errno_);
+}
+
+void AccumulateSample (const perf_sample* before, const perf_sample* after, perf_sample* total) {
+  for (int e = 0; e < NUM_PERF_EVENTS; e++) {
+    // Scaling for multiplexing can make a reading dip slightly below the last
+    if (after->count[e] > before->count[e]) {
+      total->count[e] += after->count[e] - before->count[e];
+    }
+  }
+}
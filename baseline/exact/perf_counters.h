@@ -0,0 +1,55 @@
+#ifndef _perf_counters_h
+#define _perf_counters_h
+
+// Hardware events counted by --perf.
+enum perf_event_kind {
+  PERF_CYCLES,
+  PERF_INSTRUCTIONS,
+  PERF_LLC_MISSES,
+  PERF_DTLB_MISSES,
+  PERF_BRANCH_MISSES,
+  NUM_PERF_EVENTS
+};
+
+// Returns the name of an event as it appears in the summary and JSON.
+const char* PerfEventName (int event);
+
+// One reading (or difference of readings) of every event. Events that could
+// not be opened read as zero and are flagged in PerfCounters::available().
+struct perf_sample {
+  unsigned long long count[NUM_PERF_EVENTS];
+};
+
+// User-space hardware counters for the calling thread and every thread it
+// creates afterwards, opened through perf_event_open(). Inherited counters
+// only follow threads spawned after Open(), and WorkStealingPool starts its
+// workers in its constructor, so the pool must be constructed after Open()
+// for the counters to cover the workers. A Read() then includes the parked
+// workers' counts as well as the calling thread's.
+//
+// Counters that the kernel, the CPU or a hypervisor refuses are skipped;
+// when none open at all the run goes on without them.
+class PerfCounters {
+ public:
+  PerfCounters();
+  ~PerfCounters();
+
+  // Opens and starts every event. Returns false, with the reason in error(),
+  // if no event could be opened.
+  bool Open();
+
+  // Reads the current totals, scaled up if the kernel had to multiplex.
+  void Read(perf_sample* sample);
+
+  bool available(int event);
+  const char* error();
+
+ private:
+  int fds_[NUM_PERF_EVENTS];
+  int errno_;
+};
+
+// Adds the events counted between before and after to total.
+void AccumulateSample (const perf_sample* before, const perf_sample* after, perf_sample* total);
+
+#endif
@@ -0,0 +1,153 @@
+// Set-associative CLOCK cache of stitching results for duplicate reads
+
+#include <string.h>
+#include <algorithm>
+#include "result_cache.h"
+
+/* Hashes the packed query bytes and strand a word at a time.
+ */
+static uint64_t HashQuery (const unsigned char* query, unsigned int bytes_per_query, unsigned int strand) {
+  uint64_t hash = 0x9E3779B97F4A7C15ULL ^ strand;
+  unsigned int b = 0;
+  for (; b + sizeof(uint64_t) <= bytes_per_query; b += sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, query + b, sizeof(uint64_t));
+    hash = (hash ^ word) * 0xFF51AFD7ED558CCDULL;
+    hash ^= hash >> 32;
+  }
+  for (; b < bytes_per_query; b++) {
+    hash = (hash ^ query[b]) * 0xC4CEB9FE1A85EC53ULL;
+  }
+  return hash ^ (hash >> 29);
+}
+
+ResultCache::ResultCache(size_t num_entries, unsigned int bytes_per_query) {
+  num_sets_ = (num_entries + CACHE_WAYS - 1) / CACHE_WAYS;
+  if (num_sets_ == 0) {
+    num_sets_ = 1;
+  }
+  bytes_per_query_ = bytes_per_query;
+  entries_.resize(num_sets_ * CACHE_WAYS);
+  hands_.resize(num_sets_, 0);
+  // Left uninitialized: only the slots of valid entries are ever read
+  queries_ = new unsigned char[entries_.size() * bytes_per_query];
+  hits_ = new unsigned int[entries_.size() * CACHE_MAX_HITS];
+  Clear();
+}
+
+ResultCache::~ResultCache() {
+  delete[] queries_;
+  delete[] hits_;
+}
+
+void ResultCache::Clear() {
+  for (size_t e = 0; e < entries_.size(); e++) {
+    entries_[e].valid = false;
+    entries_[e].referenced = false;
+  }
+}
+
+ptrdiff_t ResultCache::Find(size_t set, uint64_t hash, const unsigned char* query, unsigned int strand) {
+  for (size_t e = set * CACHE_WAYS; e < (set + 1) * CACHE_WAYS; e++) {
+    const Entry* entry = &entries_[e];
+    if (entry->valid && entry->hash == hash && entry->strand == strand &&
+        memcmp(queries_ + e * bytes_per_query_, query, bytes_per_query_) == 0) {
+      return (ptrdiff_t) e;
+    }
+  }
+  return -1;
+}
+
+void ResultCache::MarkServed(const unsigned char* queries, unsigned int num_queries, unsigned int num_strands,
+                             unsigned char* served) {
+  size_t num_slots = (size_t) num_queries * num_strands;
+  size_t table_size = 1;
+  while (table_size < 2 * num_slots) {
+    table_size *= 2;
+  }
+  if (first_slots_.size() < table_size) {
+    first_slots_.resize(table_size);
+  }
+  std::fill(first_slots_.begin(), first_slots_.begin() + table_size, 0);
+  for (size_t v = 0; v < num_slots; v++) {
+    const unsigned char* query = queries + (v / num_strands) * bytes_per_query_;
+    unsigned int strand = v % num_strands;
+    uint64_t hash = HashQuery(query, bytes_per_query_, strand);
+    size_t set = hash % num_sets_;
+    {
+      std::lock_guard<std::mutex> guard(locks_[set % CACHE_LOCKS]);
+      served[v] = Find(set, hash, query, strand) >= 0;
+    }
+    if (served[v]) {
+      continue;
+    }
+    // Linear probing for an earlier slot with the same query and strand
+    size_t probe = (hash >> 17) & (table_size - 1);
+    while (first_slots_[probe] != 0) {
+      size_t u = first_slots_[probe] - 1;
+      if (u % num_strands == strand &&
+          memcmp(queries + (u / num_strands) * bytes_per_query_, query, bytes_per_query_) == 0) {
+        served[v] = 1;
+        break;
+      }
+      probe = (probe + 1) & (table_size - 1);
+    }
+    if (!served[v]) {
+      first_slots_[probe] = (uint32_t) v + 1;
+    }
+  }
+}
+
+bool ResultCache::Lookup(const unsigned char* query, unsigned int strand, StitchScratch* scratch,
+                         unsigned int** hits, unsigned int* num_hits) {
+  uint64_t hash = HashQuery(query, bytes_per_query_, strand);
+  size_t set = hash % num_sets_;
+  std::lock_guard<std::mutex> guard(locks_[set % CACHE_LOCKS]);
+  ptrdiff_t e = Find(set, hash, query, strand);
+  if (e < 0) {
+    return false;
+  }
+  Entry* entry = &entries_[e];
+  entry->referenced = true;
+  *num_hits = entry->num_hits;
+  *hits = scratch->AllocateResult(*num_hits);
+  if (*num_hits > 0) {
+    memcpy(*hits, hits_ + e * CACHE_MAX_HITS, *num_hits * sizeof(unsigned int));
+  }
+  return true;
+}
+
+void ResultCache::Insert(const unsigned char* query, unsigned int strand, const unsigned int* hits,
+                         unsigned int num_hits) {
+  if (num_hits > CACHE_MAX_HITS) {
+    return;
+  }
+  uint64_t hash = HashQuery(query, bytes_per_query_, strand);
+  size_t set = hash % num_sets_;
+  std::lock_guard<std::mutex> guard(locks_[set % CACHE_LOCKS]);
+  if (Find(set, hash, query, strand) >= 0) {
+    // Another thread stitched the same read meanwhile
+    return;
+  }
+  // Sweep the hand past referenced entries, clearing their bit, until an
+  // empty or unreferenced one comes up
+  size_t e;
+  while (true) {
+    e = set * CACHE_WAYS + hands_[set];
+    hands_[set] = (hands_[set] + 1) % CACHE_WAYS;
+    if (!entries_[e].valid || !entries_[e].referenced) {
+      break;
+    }
+    entries_[e].referenced = false;
+  }
+  Entry* victim = &entries_[e];
+  memcpy(queries_ + e * bytes_per_query_, query, bytes_per_query_);
+  if (num_hits > 0) {
+    memcpy(hits_ + e * CACHE_MAX_HITS, hits, num_hits * sizeof(unsigned int));
+  }
+  victim->num_hits = num_hits;
+  victim->hash = hash;
+  victim->strand = strand;
+  victim->valid = true;
+  victim->referenced = false;
+}
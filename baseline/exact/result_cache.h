@@ -0,0 +1,84 @@
+#ifndef _result_cache_h
+#define _result_cache_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <mutex>
+#include <vector>
+#include "scratch.h"
+
+// Bounded cache of stitching results keyed on the packed query bytes, so
+// exact duplicate reads (PCR duplicates, adapter dimers, highly expressed
+// transcripts) are stitched once. It is shared by all worker threads.
+// Reads already cached when their chunk reaches the interval lookup phase
+// skip their lookups as well.
+//
+// The cache is set-associative: a query's hash picks a set of
+// CACHE_WAYS entries, and when the set is full the entry to replace is
+// chosen CLOCK style, giving each recently hit entry a second chance. Sets
+// are guarded by a fixed number of striped locks.
+#define CACHE_WAYS 4
+#define CACHE_LOCKS 64
+
+// Results with more hits than this are not cached. Every entry reserves
+// room for this many hits up front, about 4 KB, so inserting never
+// allocates; the pages are only touched as entries fill.
+#define CACHE_MAX_HITS 1024
+
+class ResultCache {
+ public:
+  // Holds at least num_entries results of queries of bytes_per_query
+  // packed bytes.
+  ResultCache(size_t num_entries, unsigned int bytes_per_query);
+  ~ResultCache();
+
+  // Sets served[v] for each strand slot v = i * num_strands + strand of
+  // num_queries consecutive packed queries whose results should not need
+  // stitching: those already cached, and repeats of an earlier slot of the
+  // same call, which will normally be cached by the time they are stitched.
+  // Clears it for the rest. Does not touch the entries' CLOCK bits.
+  void MarkServed(const unsigned char* queries, unsigned int num_queries, unsigned int num_strands,
+                  unsigned char* served);
+
+  // Looks up the results of a query on the given strand. On a hit, copies
+  // them into scratch's result arena (they stay valid until its next
+  // Reset() even if the entry is evicted), points hits at them, sets
+  // num_hits and returns true.
+  bool Lookup(const unsigned char* query, unsigned int strand, StitchScratch* scratch, unsigned int** hits,
+              unsigned int* num_hits);
+
+  // Stores the results of a query, evicting another entry if needed, into
+  // the entry's preallocated slot. Results longer than CACHE_MAX_HITS are
+  // skipped.
+  void Insert(const unsigned char* query, unsigned int strand, const unsigned int* hits, unsigned int num_hits);
+
+  // Drops every entry, keeping the memory for reuse.
+  void Clear();
+
+ private:
+  struct Entry {
+    uint64_t hash;
+    unsigned int strand;
+    bool valid;
+    bool referenced;                  // CLOCK bit, set on every hit
+    unsigned int num_hits;
+  };
+
+  // Returns the index of the matching entry in set, or -1.
+  ptrdiff_t Find(size_t set, uint64_t hash, const unsigned char* query, unsigned int strand);
+
+  std::vector<Entry> entries_;        // num_sets_ sets of CACHE_WAYS entries
+  std::vector<unsigned char> hands_;  // CLOCK hand of each set
+  // Slot storage of entry e: its packed query at queries_ + e *
+  // bytes_per_query_ and its hits at hits_ + e * CACHE_MAX_HITS
+  unsigned char* queries_;
+  unsigned int* hits_;
+  unsigned int bytes_per_query_;
+  size_t num_sets_;
+  // MarkServed() probe table: slot + 1 of the first occurrence of each
+  // query, 0 if empty. Grows to twice the largest call's slots.
+  std::vector<uint32_t> first_slots_;
+  std::mutex locks_[CACHE_LOCKS];
+};
+
+#endif
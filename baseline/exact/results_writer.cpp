@@ -0,0 +1,121 @@
+// Formats and writes the per-query results of the baseline
+
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <charconv>
+#include <fcntl.h>
+#include <unistd.h>
+#include "results_writer.h"
+
+void FormatResult (results_format format, unsigned int query_id, const unsigned int* hits, unsigned int num_hits,
+                   std::string* out) {
+  if (format == RESULTS_BINARY) {
+    unsigned int header[2] = {query_id, num_hits};
+    out->append((const char*) header, sizeof(header));
+    out->append((const char*) hits, num_hits * sizeof(unsigned int));
+    return;
+  }
+  // A 32-bit position is at most 10 digits, plus the separating space
+  char text[11];
+  for (unsigned int k = 0; k < num_hits; k++) {
+    char* end = std::to_chars(text, text + 10, hits[k]).ptr;
+    *end++ = ' ';
+    out->append(text, end - text);
+  }
+  out->push_back('\n');
+}
+
+void FormatContigResult (results_format format, unsigned int query_id, const unsigned int* hits,
+                         unsigned int num_hits, const contig_table* contigs, unsigned int span, std::string* out) {
+  unsigned int contig;
+  unsigned int offset;
+  if (format == RESULTS_BINARY) {
+    size_t header_at = out->size();
+    unsigned int header[2] = {query_id, 0};
+    out->append((const char*) header, sizeof(header));
+    for (unsigned int k = 0; k < num_hits; k++) {
+      if (LocateHit(contigs, hits[k], span, &contig, &offset)) {
+        unsigned int record[2] = {contig, offset};
+        out->append((const char*) record, sizeof(record));
+        header[1]++;
+      }
+    }
+    out->replace(header_at, sizeof(header), (const char*) header, sizeof(header));
+    return;
+  }
+  char text[12];
+  for (unsigned int k = 0; k < num_hits; k++) {
+    if (LocateHit(contigs, hits[k], span, &contig, &offset)) {
+      out->append(contigs->names[contig]);
+      text[0] = ':';
+      char* end = std::to_chars(text + 1, text + 11, offset).ptr;
+      *end++ = ' ';
+      out->append(text, end - text);
+    }
+  }
+  out->push_back('\n');
+}
+
+ResultsWriter::ResultsWriter(const char* filename, results_format format, size_t buffer_size) {
+  fd_ = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd_ < 0) {
+    std::cerr << "Could not open " << filename << std::endl;
+    exit(1);
+  }
+  format_ = format;
+  buffer_ = new char[buffer_size];
+  buffer_size_ = buffer_size;
+  buffer_used_ = 0;
+}
+
+ResultsWriter::~ResultsWriter() {
+  Close();
+  delete[] buffer_;
+}
+
+void ResultsWriter::WriteHeader(unsigned int num_queries) {
+  if (format_ == RESULTS_BINARY) {
+    Write(std::string((const char*) &num_queries, sizeof(unsigned int)));
+  } else {
+    Write(std::to_string(num_queries) + "\n");
+  }
+}
+
+void ResultsWriter::Write(const std::string& records) {
+  if (buffer_used_ + records.size() > buffer_size_) {
+    Flush();
+  }
+  if (records.size() >= buffer_size_) {
+    WriteFully(records.data(), records.size());
+    return;
+  }
+  memcpy(buffer_ + buffer_used_, records.data(), records.size());
+  buffer_used_ += records.size();
+}
+
+void ResultsWriter::Close() {
+  if (fd_ < 0) {
+    return;
+  }
+  Flush();
+  close(fd_);
+  fd_ = -1;
+}
+
+void ResultsWriter::Flush() {
+  WriteFully(buffer_, buffer_used_);
+  buffer_used_ = 0;
+}
+
+void ResultsWriter::WriteFully(const char* data, size_t length) {
+  while (length > 0) {
+    ssize_t written = write(fd_, data, length);
+    if (written < 0) {
+      std::cerr << "Error writing results" << std::endl;
+      exit(1);
+    }
+    data += written;
+    length -= written;
+  }
+}
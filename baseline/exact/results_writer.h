@@ -0,0 +1,65 @@
+#ifndef _results_writer_h
+#define _results_writer_h
+
+#include <stddef.h>
+#include <string>
+#include "contigs.h"
+
+// Results file formats.
+//
+// RESULTS_TEXT is the original ASCII format:
+//   Number of queries, newline
+//   One line per query holding its hit positions, each followed by a space
+//
+// RESULTS_BINARY is a compact little-endian format:
+//   Number of queries (4 bytes)
+//   Per query: query id (4 bytes), hit count (4 bytes), hit positions
+//              (4 bytes each)
+//
+// With a contig table (--contigs) each hit is written as its contig and
+// offset instead: "name:offset" in text, and contig index then offset
+// (4 bytes each) in binary. Hits that match across a contig junction are
+// dropped, and the binary hit count counts only those written.
+enum results_format {
+  RESULTS_TEXT,
+  RESULTS_BINARY
+};
+
+// Appends the results record of one query to out in the given format. Text
+// is formatted with std::to_chars rather than iostreams.
+void FormatResult (results_format format, unsigned int query_id, const unsigned int* hits, unsigned int num_hits,
+                   std::string* out);
+
+// FormatResult() for a joined reference: locates each hit, which covers
+// span bases, in contigs.
+void FormatContigResult (results_format format, unsigned int query_id, const unsigned int* hits,
+                         unsigned int num_hits, const contig_table* contigs, unsigned int span, std::string* out);
+
+// Writes a results file through a large user-space buffer so that the file
+// is written in big blocks instead of once per hit or per line.
+class ResultsWriter {
+ public:
+  ResultsWriter(const char* filename, results_format format, size_t buffer_size);
+  ~ResultsWriter();
+
+  // Writes the results file header.
+  void WriteHeader(unsigned int num_queries);
+
+  // Appends already formatted records to the file.
+  void Write(const std::string& records);
+
+  // Flushes the buffer and closes the file.
+  void Close();
+
+ private:
+  void Flush();
+  void WriteFully(const char* data, size_t length);
+
+  int fd_;
+  results_format format_;
+  char* buffer_;
+  size_t buffer_size_;
+  size_t buffer_used_;
+};
+
+#endif
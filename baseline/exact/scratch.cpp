@@ -0,0 +1,94 @@
+// Reusable per-thread stitching buffers and result arena
+
+#include "scratch.h"
+#include "merge.h"
+
+// Smallest result chunk; results larger than this get a chunk of their own
+#define RESULT_CHUNK_LENGTH 65536
+
+StitchScratch::StitchScratch() {
+  buffers_[0] = NULL;
+  buffers_[1] = NULL;
+  capacity_ = 0;
+  chunk_ = 0;
+  chunk_used_ = 0;
+}
+
+StitchScratch::~StitchScratch() {
+  delete[] buffers_[0];
+  delete[] buffers_[1];
+  for (size_t i = 0; i < chunks_.size(); i++) {
+    delete[] chunks_[i];
+  }
+}
+
+void StitchScratch::Reserve(unsigned int length) {
+  if (length <= capacity_) {
+    return;
+  }
+  // Round up generously so a slowly growing maximum does not reallocate
+  // on every new record.
+  unsigned int capacity = capacity_ < 1024 ? 1024 : capacity_;
+  while (capacity < length) {
+    capacity *= 2;
+  }
+  for (unsigned int i = 0; i < 2; i++) {
+    delete[] buffers_[i];
+    buffers_[i] = new unsigned int[capacity + MERGE_RESULT_PADDING];
+  }
+  capacity_ = capacity;
+}
+
+unsigned int* StitchScratch::buffer(unsigned int which) {
+  return buffers_[which];
+}
+
+unsigned int* StitchScratch::Order(unsigned int num_subreads) {
+  if (order_.size() < num_subreads) {
+    order_.resize(num_subreads);
+  }
+  return order_.data();
+}
+
+unsigned int* StitchScratch::Unpacked(unsigned int length) {
+  // One spare entry for UnpackPositions()'s unconditional store
+  if (unpacked_.size() < (size_t) length + 1) {
+    unpacked_.resize((size_t) length + 1);
+  }
+  return unpacked_.data();
+}
+
+kway_list* StitchScratch::KWayLists(unsigned int num_lists) {
+  if (kway_lists_.size() < num_lists) {
+    kway_lists_.resize(num_lists);
+  }
+  return kway_lists_.data();
+}
+
+uint64_t* StitchScratch::QueryWords(unsigned int num_nucleotides) {
+  size_t num_words = (num_nucleotides + 31) / 32;
+  if (query_words_.size() < num_words) {
+    query_words_.resize(num_words);
+  }
+  return query_words_.data();
+}
+
+unsigned int* StitchScratch::AllocateResult(unsigned int length) {
+  while (chunk_ < chunks_.size() && chunk_used_ + length > chunk_lengths_[chunk_]) {
+    chunk_++;
+    chunk_used_ = 0;
+  }
+  if (chunk_ == chunks_.size()) {
+    size_t chunk_length = length < RESULT_CHUNK_LENGTH ? RESULT_CHUNK_LENGTH : length;
+    chunks_.push_back(new unsigned int[chunk_length]);
+    chunk_lengths_.push_back(chunk_length);
+  }
+  unsigned int* result = chunks_[chunk_] + chunk_used_;
+  chunk_used_ += length;
+  return result;
+}
+
+void StitchScratch::Reset() {
+  chunk_ = 0;
+  chunk_used_ = 0;
+}
@@ -0,0 +1,60 @@
+#ifndef _scratch_h
+#define _scratch_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "merge.h"
+
+// Per-thread working memory for stitching. Everything here only ever grows,
+// so once the buffers have reached the largest interval seen the stitching
+// loop runs without touching the heap.
+class StitchScratch {
+ public:
+  StitchScratch();
+  ~StitchScratch();
+
+  // Makes sure both ping-pong buffers can hold a running result of length
+  // positions, plus the padding the merge kernels write past the end.
+  void Reserve(unsigned int length);
+
+  // Returns ping-pong buffer 0 or 1.
+  unsigned int* buffer(unsigned int which);
+
+  // Returns room for num_subreads subread indices.
+  unsigned int* Order(unsigned int num_subreads);
+
+  // Returns room for a position list of length entries unpacked from a
+  // bit-packed table.
+  unsigned int* Unpacked(unsigned int length);
+
+  // Returns room for num_lists k-way merge inputs.
+  kway_list* KWayLists(unsigned int num_lists);
+
+  // Returns room for a query of num_nucleotides packed into 64-bit words.
+  uint64_t* QueryWords(unsigned int num_nucleotides);
+
+  // Bump-allocates length entries for a finished query's hits. The memory
+  // stays valid until the next Reset().
+  unsigned int* AllocateResult(unsigned int length);
+
+  // Releases every result allocated since the last Reset(), keeping the
+  // underlying chunks for reuse.
+  void Reset();
+
+ private:
+  unsigned int* buffers_[2];
+  unsigned int capacity_;
+  std::vector<unsigned int> order_;
+  std::vector<unsigned int> unpacked_;
+  std::vector<uint64_t> query_words_;
+  std::vector<kway_list> kway_lists_;
+
+  // Result chunks, used in order; chunk_ is the one being filled
+  std::vector<unsigned int*> chunks_;
+  std::vector<size_t> chunk_lengths_;
+  size_t chunk_;
+  size_t chunk_used_;
+};
+
+#endif
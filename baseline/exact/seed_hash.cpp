@@ -0,0 +1,48 @@
+// Looks up subreads in the hash seed index written by gen_hash_tables
+
+#include "seed_hash.h"
+
+static const char* kIndexNames[] = {"dense", "hash"};
+
+const char* SeedIndexName (seed_index index) {
+  return kIndexNames[index];
+}
+
+unsigned long long LookupHashIntervals (subread_list* srlist, size_t first, size_t last, table* hash_table,
+                                        size_t prefetch_distance, interval_list* ilist) {
+  hash_slot* slots = (hash_slot*) hash_table->ptr;
+  uint64_t num_slots = hash_table->length / HASH_SLOT_WORDS;
+  uint64_t slot_mask = num_slots - 1;
+  unsigned int slot_bits = __builtin_ctzll(num_slots);
+  if (prefetch_distance > 0) {
+    for (size_t s = first; s < first + prefetch_distance && s < last; s++) {
+      __builtin_prefetch(&slots[HashSeedSlot(srlist->ptr[s], slot_bits)]);
+    }
+  }
+  unsigned long long num_probes = 0;
+  for (size_t s = first; s < last; s++) {
+    if (prefetch_distance > 0 && s + prefetch_distance < last) {
+      __builtin_prefetch(&slots[HashSeedSlot(srlist->ptr[s + prefetch_distance], slot_bits)]);
+    }
+    uint64_t seed = srlist->ptr[s];
+    uint64_t slot = HashSeedSlot(seed, slot_bits);
+    ilist->start[s] = 0;
+    ilist->end[s] = 0;
+    // The table is at most half full, so probe runs are short and always
+    // end at an empty slot
+    while (true) {
+      num_probes++;
+      hash_slot* entry = &slots[slot];
+      if (entry->start == entry->end) {
+        break;
+      }
+      if (entry->seed == seed) {
+        ilist->start[s] = entry->start;
+        ilist->end[s] = entry->end;
+        break;
+      }
+      slot = (slot + 1) & slot_mask;
+    }
+  }
+  return num_probes;
+}
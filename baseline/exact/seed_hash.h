@@ -0,0 +1,38 @@
+#ifndef _seed_hash_h
+#define _seed_hash_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include "def.h"
+#include "table_io.h"
+#include "hash_format.h"
+
+// Seed index backends, chosen with --index.
+//
+// INDEX_DENSE is the interval table written by gen_tables: one entry for
+// each of the 4^k possible seeds, which caps k at 15. INDEX_HASH is the
+// table written by gen_hash_tables, which stores only the seeds present in
+// the reference in an open-addressing hash table keyed on the 64-bit packed
+// seed, so k can go up to 32. Both point into a position table of the same
+// format.
+enum seed_index {
+  INDEX_DENSE,
+  INDEX_HASH
+};
+
+// Longest seed each backend can index
+#define MAX_DENSE_SEED_LENGTH 15
+#define MAX_HASH_SEED_LENGTH 32
+
+// Returns the name of a backend as used by --index.
+const char* SeedIndexName (seed_index index);
+
+// Looks up the position table interval of every subread in [first, last)
+// of the flat subread list in a hash table loaded by ReadHashTable() or
+// MapHashTable(), prefetching the home slot prefetch_distance subreads
+// ahead like LookupIntervals(). Seeds absent from the reference get an
+// empty interval. Returns the number of slots probed.
+unsigned long long LookupHashIntervals (subread_list* srlist, size_t first, size_t last, table* hash_table,
+                                        size_t prefetch_distance, interval_list* ilist);
+
+#endif
@@ -0,0 +1,71 @@
+// Looks up intervals for a whole chunk of subreads in sorted order
+
+#include <assert.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include "sort_join.h"
+
+// Widest radix digit; wider digits mean fewer passes over the keys, but
+// the counts (and the scatter targets) must stay cache resident
+#define MAX_RADIX_BITS 13
+
+void SortSubreadKeys (const uint64_t* subreads, size_t num_subreads, unsigned int value_bits, uint64_t* keys,
+                      uint64_t* temp) {
+  for (size_t s = 0; s < num_subreads; s++) {
+    assert(value_bits <= 32 && (subreads[s] >> value_bits) == 0);
+    keys[s] = (subreads[s] << 32) | (uint32_t) s;
+  }
+  // Least significant digit first; each pass is stable. Only the bits a
+  // seed can occupy are sorted, split evenly over as few passes as possible
+  // (k=13 takes two 13-bit passes, k=15 three 10-bit ones).
+  unsigned int num_passes = (value_bits + MAX_RADIX_BITS - 1) / MAX_RADIX_BITS;
+  unsigned int digit_bits = (value_bits + num_passes - 1) / num_passes;
+  uint64_t digit_mask = (1ULL << digit_bits) - 1;
+  std::vector<size_t> counts((size_t) 1 << digit_bits);
+  uint64_t* from = keys;
+  uint64_t* to = temp;
+  for (unsigned int pass = 0; pass < num_passes; pass++) {
+    unsigned int shift = 32 + pass * digit_bits;
+    std::fill(counts.begin(), counts.end(), 0);
+    for (size_t s = 0; s < num_subreads; s++) {
+      counts[(from[s] >> shift) & digit_mask]++;
+    }
+    size_t offset = 0;
+    for (size_t b = 0; b < counts.size(); b++) {
+      size_t count = counts[b];
+      counts[b] = offset;
+      offset += count;
+    }
+    for (size_t s = 0; s < num_subreads; s++) {
+      to[counts[(from[s] >> shift) & digit_mask]++] = from[s];
+    }
+    std::swap(from, to);
+  }
+  if (from != keys) {
+    memcpy(keys, from, num_subreads * sizeof(uint64_t));
+  }
+}
+
+unsigned long long SweepIntervals (const uint64_t* keys, size_t first, size_t last, table* interval_table,
+                                   interval_list* ilist) {
+  unsigned int* it = interval_table->ptr;
+  unsigned long long num_accesses = 0;
+  uint32_t value = 0;
+  uint32_t start = 0;
+  uint32_t end = 0;
+  for (size_t k = first; k < last; k++) {
+    uint32_t subread = (uint32_t) (keys[k] >> 32);
+    if (k == first || subread != value) {
+      assert(subread < interval_table->length - 1);
+      value = subread;
+      start = it[subread];
+      end = it[subread + 1];
+      num_accesses += 2;
+    }
+    uint32_t s = (uint32_t) keys[k];
+    ilist->start[s] = start;
+    ilist->end[s] = end;
+  }
+  return num_accesses;
+}
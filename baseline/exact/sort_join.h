@@ -0,0 +1,31 @@
+#ifndef _sort_join_h
+#define _sort_join_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include "def.h"
+#include "table_io.h"
+
+// Sort-based interval table join for --sort-join. Instead of looking up
+// subreads in query order, which lands on random interval table entries,
+// all subreads of a chunk are sorted by value and the table is swept in
+// ascending address order. Neighbouring lookups then share cache lines and
+// pages and the hardware prefetcher can follow them, and repeated subreads
+// are looked up once. Results are scattered back to each subread's slot in
+// the interval list.
+
+// Sorts the num_subreads subreads of a flat subread list by value. Each
+// key holds a subread value in its upper 32 bits and the subread's index in
+// the list in its lower 32, so only dense index seeds (value_bits <= 32)
+// can be sorted. keys and temp must each hold num_subreads entries. The
+// sorted keys end up in keys.
+void SortSubreadKeys (const uint64_t* subreads, size_t num_subreads, unsigned int value_bits, uint64_t* keys,
+                      uint64_t* temp);
+
+// Resolves the sorted keys [first, last) against the interval table,
+// storing each subread's interval at its index in ilist. Returns the number
+// of interval table accesses, which counts each distinct value once.
+unsigned long long SweepIntervals (const uint64_t* keys, size_t first, size_t last, table* interval_table,
+                                   interval_list* ilist);
+
+#endif
@@ -0,0 +1,42 @@
+// Derives reverse-complement subreads and query words from packed queries
+
+#include "strand.h"
+#include "verify.h"
+
+uint64_t ReverseComplementWord (uint64_t word) {
+  word = ~word;
+  // Reverse the bytes, then the two nibbles of each byte, then the two
+  // nucleotides of each nibble
+  word = __builtin_bswap64(word);
+  word = ((word >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((word & 0x0F0F0F0F0F0F0F0FULL) << 4);
+  word = ((word >> 2) & 0x3333333333333333ULL) | ((word & 0x3333333333333333ULL) << 2);
+  return word;
+}
+
+void SplitReverseComplement (const unsigned char* query, unsigned int query_length, unsigned int subread_length,
+                             unsigned int stride, unsigned int num_subreads, uint64_t* subreads) {
+  uint64_t mask = (subread_length < NUCLEOTIDES_PER_WORD) ? (1ULL << (subread_length * 2)) - 1 : ~0ULL;
+  for (unsigned int j = 0; j < num_subreads; j++) {
+    // The forward subread sits in the top bits of the window, so after the
+    // reversal its reverse complement is in the bottom bits
+    uint64_t window = PackedWindow(query, query_length - j * stride - subread_length);
+    subreads[j] = ReverseComplementWord(window) & mask;
+  }
+}
+
+void PackReverseComplementWords (const unsigned char* query, unsigned int query_length, unsigned int num_nucleotides,
+                                 uint64_t* words) {
+  unsigned int num_words = (num_nucleotides + NUCLEOTIDES_PER_WORD - 1) / NUCLEOTIDES_PER_WORD;
+  for (unsigned int w = 0; w < num_words; w++) {
+    // Word w holds the reverse complement of the forward nucleotides
+    // ending w*32 before the end of the query
+    unsigned int end = query_length - w * NUCLEOTIDES_PER_WORD;
+    if (end >= NUCLEOTIDES_PER_WORD) {
+      words[w] = ReverseComplementWord(PackedWindow(query, end - NUCLEOTIDES_PER_WORD));
+    } else {
+      // Fewer than 32 nucleotides left; the unused low bits are masked off
+      // by VerifyCandidate()
+      words[w] = ReverseComplementWord(PackedWindow(query, 0)) << ((NUCLEOTIDES_PER_WORD - end) * 2);
+    }
+  }
+}
@@ -0,0 +1,29 @@
+#ifndef _strand_h
+#define _strand_h
+
+#include <stdint.h>
+
+// Reverse-complement strand support for --both-strands. With the 2-bit
+// encoding A=00, C=01, G=10, T=11 the complement of a nucleotide is its
+// bitwise NOT, so the reverse complement of a packed sequence is a NOT plus
+// a reversal of its 2-bit groups, done here a word at a time.
+
+// Returns the reverse complement of the 32 nucleotides packed in word,
+// first nucleotide in the top two bits.
+uint64_t ReverseComplementWord (uint64_t word);
+
+// Splits the reverse complement of a packed query of query_length
+// nucleotides into num_subreads subreads of subread_length nucleotides,
+// starting every stride nucleotides, like SplitQuery() (stride =
+// subread_length) or SplitQueryOffsets() (stride 1) do for the forward
+// strand. Subread j of the reverse strand is derived from the forward
+// nucleotides ending j*stride before the end of the query.
+void SplitReverseComplement (const unsigned char* query, unsigned int query_length, unsigned int subread_length,
+                             unsigned int stride, unsigned int num_subreads, uint64_t* subreads);
+
+// Packs the first num_nucleotides nucleotides of the reverse complement of
+// a query into 64-bit words, like PackQueryWords().
+void PackReverseComplementWords (const unsigned char* query, unsigned int query_length, unsigned int num_nucleotides,
+                                 uint64_t* words);
+
+#endif
@@ -2,34 +2,510 @@
 
 #include <iostream>
 #include <fstream>
+#include <cstdlib>
+#include <stdint.h>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "table_io.h"
+#include "seed_hash.h"
+#include "packed_positions.h"
+#include "elias_fano.h"
+
+#define HUGE_PAGE_2M (2UL << 20)
+#define HUGE_PAGE_1G (1UL << 30)
+
+static const char* kPagesNames[] = {"off", "thp", "2m", "1g"};
+
+const char* TablePagesName (table_pages pages) {
+  return kPagesNames[pages];
+}
+
+static const char* kFormatNames[] = {"raw", "varint", "packed", "elias-fano"};
+
+const char* PositionFormatName (position_format format) {
+  return kFormatNames[format];
+}
+
+/* Maps length bytes of anonymous memory from the hugetlb pool with pages of
+ * 2^page_shift bytes. Returns NULL if the pool cannot supply them.
+ */
+static void* MapHugeTLB (size_t length, int page_shift) {
+  void* mapping = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (page_shift << MAP_HUGE_SHIFT), -1, 0);
+  return (mapping == MAP_FAILED) ? NULL : mapping;
+}
+
+/* Maps length bytes of anonymous memory aligned to a 2 MB boundary and asks
+ * for transparent huge pages. Returns NULL if the hint is not supported.
+ */
+static void* MapTransparentHuge (size_t length) {
+  // Over-map by one huge page and trim, so every 2 MB of the table can be
+  // backed by a single huge page
+  size_t padded_length = length + HUGE_PAGE_2M;
+  char* padded = (char*) mmap(NULL, padded_length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (padded == MAP_FAILED) {
+    return NULL;
+  }
+  char* aligned = (char*) (((uintptr_t) padded + HUGE_PAGE_2M - 1) & ~(HUGE_PAGE_2M - 1));
+  if (aligned > padded) {
+    munmap(padded, aligned - padded);
+  }
+  munmap(aligned + length, padded + padded_length - (aligned + length));
+  if (madvise(aligned, length, MADV_HUGEPAGE) != 0) {
+    munmap(aligned, length);
+    return NULL;
+  }
+  return aligned;
+}
+
+/* Allocates room for num_words table words backed by the requested pages,
+ * falling back to smaller pages as needed, and records the backing in t.
+ */
+static unsigned int* AllocateTable (size_t num_words, table_pages pages, table* t) {
+  size_t length = num_words * sizeof(unsigned int);
+  void* mapping = NULL;
+  if (pages == PAGES_1G) {
+    t->mapping_length = (length + HUGE_PAGE_1G - 1) & ~(HUGE_PAGE_1G - 1);
+    mapping = MapHugeTLB(t->mapping_length, 30);
+    if (mapping == NULL) {
+      pages = PAGES_2M;
+    }
+  }
+  if (pages == PAGES_2M) {
+    t->mapping_length = (length + HUGE_PAGE_2M - 1) & ~(HUGE_PAGE_2M - 1);
+    mapping = MapHugeTLB(t->mapping_length, 21);
+    if (mapping == NULL) {
+      pages = PAGES_THP;
+    }
+  }
+  if (pages == PAGES_THP) {
+    t->mapping_length = (length + HUGE_PAGE_2M - 1) & ~(HUGE_PAGE_2M - 1);
+    mapping = MapTransparentHuge(t->mapping_length);
+    if (mapping == NULL) {
+      pages = PAGES_DEFAULT;
+    }
+  }
+  t->pages = pages;
+  t->mapping = mapping;
+  if (mapping == NULL) {
+    t->mapping_length = 0;
+    return new unsigned int[num_words];
+  }
+  return (unsigned int*) mapping;
+}
 
 /* Reads in the interval table from the given filename. Allocates the table
  * space at the given address and stores the contents.
  */
-void ReadIntervalTable (char* filename, table* interval_table) {
+void ReadIntervalTable (char* filename, table* interval_table, table_pages pages) {
+  *interval_table = table();
   unsigned int interval_table_size;
   std::ifstream interval_table_file;
   interval_table_file.open(filename);
   interval_table_file.read((char *)(&interval_table_size), sizeof(unsigned int));
-  interval_table->ptr = new unsigned int[interval_table_size];
+  interval_table->ptr = AllocateTable(interval_table_size, pages, interval_table);
   interval_table->length = interval_table_size;
   interval_table_file.read((char *)(interval_table->ptr), interval_table_size * sizeof(unsigned int));
   interval_table_file.close();
+  interval_table->step = 1;
+}
+
+/* Returns the number of positions in a position table for the given
+ * reference length and header seed length word, and sets its step.
+ */
+static unsigned int PositionTableLength (unsigned int ref_seq_length, unsigned int seed_length_word,
+                                         table* position_table) {
+  unsigned int seed_length = seed_length_word & POSITION_SEED_MASK;
+  unsigned int step = (seed_length_word & ~POSITION_FORMAT_FLAGS) >> POSITION_STEP_SHIFT;
+  position_table->step = (step == 0) ? 1 : step;
+  return (ref_seq_length - seed_length) / position_table->step + 1;
+}
+
+/* Exits with a message unless the format flags of a position table
+ * header's seed length word match the expected format (raw, packed or
+ * Elias-Fano; a varint table has a plain header).
+ */
+static void CheckFormatFlags (char* filename, unsigned int seed_length_word, position_format expected) {
+  position_format actual = POSITIONS_RAW;
+  if (seed_length_word & POSITION_PACKED_FLAG) {
+    actual = POSITIONS_PACKED;
+  } else if (seed_length_word & POSITION_ELIAS_FANO_FLAG) {
+    actual = POSITIONS_ELIAS_FANO;
+  }
+  if (actual != expected) {
+    std::cerr << "Position table " << filename << " is " << PositionFormatName(actual) << "; load it with"
+              << " --positions " << PositionFormatName(actual) << std::endl;
+    exit(1);
+  }
+}
+
+/* Returns the number of table words holding a packed stream of
+ * position_table_length positions of the given bits, padding included.
+ * Exits with a message if bits is out of range.
+ */
+static unsigned int PackedTableWords (char* filename, unsigned int position_table_length, unsigned int bits) {
+  if (bits == 0 || bits > 32) {
+    std::cerr << "Invalid bits per position in " << filename << std::endl;
+    exit(1);
+  }
+  size_t stream_bytes = ((uint64_t) position_table_length * bits + 7) / 8 + PACKED_POSITION_PADDING;
+  return (unsigned int) ((stream_bytes + sizeof(unsigned int) - 1) / sizeof(unsigned int));
 }
 
 /* Reads in the position table from the given filename. Allocates the table
  * space at the given address and stores the contents.
  */
-void ReadPositionTable (char* filename, table* position_table) {
+void ReadPositionTable (char* filename, table* position_table, table_pages pages) {
+  *position_table = table();
+  unsigned int ref_seq_length;
+  unsigned int seed_length;
+  std::ifstream position_table_file;
+  position_table_file.open(filename);
+  position_table_file.read((char *)(&ref_seq_length), sizeof(unsigned int));
+  position_table_file.read((char *)(&seed_length), sizeof(unsigned int));
+  CheckFormatFlags(filename, seed_length, POSITIONS_RAW);
+  unsigned int position_table_length = PositionTableLength(ref_seq_length, seed_length, position_table);
+  position_table->ptr = AllocateTable(position_table_length, pages, position_table);
+  position_table->length = position_table_length;
+  position_table_file.read((char *)(position_table->ptr), (size_t) position_table_length * sizeof(unsigned int));
+  position_table_file.close();
+  position_table->format = POSITIONS_RAW;
+}
+
+/* Reads in the bit-packed position table from the given filename: the
+ * reference and seed length header, the bits per position, then the packed
+ * stream and its padding.
+ */
+void ReadPackedPositionTable (char* filename, table* position_table, table_pages pages) {
+  *position_table = table();
   unsigned int ref_seq_length;
   unsigned int seed_length;
+  unsigned int bits;
   std::ifstream position_table_file;
   position_table_file.open(filename);
+  if (!position_table_file.is_open()) {
+    std::cerr << "Could not open " << filename << std::endl;
+    exit(1);
+  }
   position_table_file.read((char *)(&ref_seq_length), sizeof(unsigned int));
   position_table_file.read((char *)(&seed_length), sizeof(unsigned int));
-  position_table->ptr = new unsigned int[ref_seq_length - seed_length + 1];
-  position_table->length = ref_seq_length - seed_length + 1;
-  position_table_file.read((char *)(position_table->ptr), (ref_seq_length - seed_length + 1) * sizeof(unsigned int));
+  position_table_file.read((char *)(&bits), sizeof(unsigned int));
+  CheckFormatFlags(filename, seed_length, POSITIONS_PACKED);
+  unsigned int position_table_length = PositionTableLength(ref_seq_length, seed_length, position_table);
+  unsigned int packed_words = PackedTableWords(filename, position_table_length, bits);
+  position_table->ptr = AllocateTable(packed_words, pages, position_table);
+  position_table->length = packed_words;
+  position_table_file.read((char *)(position_table->ptr), (size_t) packed_words * sizeof(unsigned int));
   position_table_file.close();
-}
\ No newline at end of file
+  position_table->format = POSITIONS_PACKED;
+  position_table->bits = bits;
+}
+
+/* Reads in the compressed position table from the given filename: the
+ * reference and seed length header, then the byte stream of every list.
+ */
+void ReadVarintPositionTable (char* filename, table* position_table, table_pages pages) {
+  *position_table = table();
+  std::ifstream position_table_file;
+  position_table_file.open(filename, std::ios::binary | std::ios::ate);
+  if (!position_table_file.is_open()) {
+    std::cerr << "Could not open " << filename << std::endl;
+    exit(1);
+  }
+  size_t stream_bytes = (size_t) position_table_file.tellg() - 2 * sizeof(unsigned int);
+  // Rounded up to whole words, with the slack zeroed
+  size_t stream_words = stream_bytes / sizeof(unsigned int) + 1;
+  position_table_file.seekg(2 * sizeof(unsigned int));
+  position_table->ptr = AllocateTable(stream_words, pages, position_table);
+  position_table->ptr[stream_words - 1] = 0;
+  position_table->length = (unsigned int) stream_words;
+  position_table->stream_bytes = stream_bytes;
+  position_table_file.read((char *)(position_table->ptr), stream_bytes);
+  position_table_file.close();
+  position_table->step = 1;
+  position_table->format = POSITIONS_VARINT;
+}
+
+/* Reads in the Elias-Fano position table from the given filename: the
+ * reference and seed length header, then the coded sections.
+ */
+void ReadEliasFanoPositionTable (char* filename, table* position_table, table_pages pages) {
+  *position_table = table();
+  unsigned int ref_seq_length;
+  unsigned int seed_length;
+  std::ifstream position_table_file;
+  position_table_file.open(filename, std::ios::binary | std::ios::ate);
+  if (!position_table_file.is_open()) {
+    std::cerr << "Could not open " << filename << std::endl;
+    exit(1);
+  }
+  size_t file_bytes = position_table_file.tellg();
+  if (file_bytes < 2 * sizeof(unsigned int) + sizeof(elias_fano_header)) {
+    std::cerr << "Truncated position table " << filename << std::endl;
+    exit(1);
+  }
+  position_table_file.seekg(0);
+  position_table_file.read((char *)(&ref_seq_length), sizeof(unsigned int));
+  position_table_file.read((char *)(&seed_length), sizeof(unsigned int));
+  CheckFormatFlags(filename, seed_length, POSITIONS_ELIAS_FANO);
+  PositionTableLength(ref_seq_length, seed_length, position_table);
+  size_t num_words = (file_bytes - 2 * sizeof(unsigned int)) / sizeof(unsigned int);
+  position_table->ptr = AllocateTable(num_words, pages, position_table);
+  position_table->length = (unsigned int) num_words;
+  position_table_file.read((char *)(position_table->ptr), num_words * sizeof(unsigned int));
+  position_table_file.close();
+  position_table->format = POSITIONS_ELIAS_FANO;
+  position_table->bits = ((elias_fano_header*) position_table->ptr)->low_bits;
+}
+
+/* Exits with a message unless a hash table header describes a table built
+ * for seed_length-nucleotide seeds that fits in a table.
+ */
+static void CheckHashHeader (char* filename, unsigned int slot_bits, unsigned int table_seed_length,
+                             unsigned int seed_length) {
+  if (table_seed_length != seed_length) {
+    std::cerr << "Hash table " << filename << " was built for seed length " << table_seed_length
+              << ", not " << seed_length << std::endl;
+    exit(1);
+  }
+  if (slot_bits == 0 || slot_bits > MAX_HASH_SLOT_BITS) {
+    std::cerr << "Invalid hash table " << filename << std::endl;
+    exit(1);
+  }
+}
+
+/* Reads in the hash table from the given filename: a header holding log2 of
+ * the slot count and the seed length, then the slots.
+ */
+void ReadHashTable (char* filename, unsigned int seed_length, table* hash_table, table_pages pages) {
+  *hash_table = table();
+  unsigned int slot_bits;
+  unsigned int table_seed_length;
+  std::ifstream hash_table_file;
+  hash_table_file.open(filename);
+  if (!hash_table_file.is_open()) {
+    std::cerr << "Could not open " << filename << std::endl;
+    exit(1);
+  }
+  hash_table_file.read((char *)(&slot_bits), sizeof(unsigned int));
+  hash_table_file.read((char *)(&table_seed_length), sizeof(unsigned int));
+  CheckHashHeader(filename, slot_bits, table_seed_length, seed_length);
+  unsigned int hash_table_words = (unsigned int) (HASH_SLOT_WORDS << slot_bits);
+  hash_table->ptr = AllocateTable(hash_table_words, pages, hash_table);
+  hash_table->length = hash_table_words;
+  hash_table_file.read((char *)(hash_table->ptr), (size_t) hash_table_words * sizeof(unsigned int));
+  hash_table_file.close();
+  hash_table->step = 1;
+}
+
+void CopyTable (const table* src, table_pages pages, table* dst) {
+  *dst = table();
+  dst->ptr = AllocateTable(src->length, pages, dst);
+  dst->length = src->length;
+  dst->step = src->step;
+  dst->format = src->format;
+  dst->bits = src->bits;
+  dst->stream_bytes = src->stream_bytes;
+  memcpy(dst->ptr, src->ptr, (size_t) src->length * sizeof(unsigned int));
+}
+
+/* Maps the whole of the given file read-only and returns the mapping,
+ * exiting with a message if the file cannot be opened or mapped.
+ */
+static void* MapTableFile (char* filename, bool populate, int advice, size_t* mapping_length) {
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    std::cerr << "Could not open " << filename << std::endl;
+    exit(1);
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    std::cerr << "Could not stat " << filename << std::endl;
+    exit(1);
+  }
+  int flags = MAP_SHARED;
+  if (populate) {
+    flags |= MAP_POPULATE;
+  }
+  void* mapping = mmap(NULL, st.st_size, PROT_READ, flags, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    std::cerr << "Could not map " << filename << std::endl;
+    exit(1);
+  }
+  if (advice != MADV_NORMAL) {
+    madvise(mapping, st.st_size, advice);
+  }
+  *mapping_length = st.st_size;
+  return mapping;
+}
+
+/* Maps the interval table in the given file. The table points into the
+ * mapping just past the length header.
+ */
+void MapIntervalTable (char* filename, table* interval_table, bool populate, int advice) {
+  *interval_table = table();
+  size_t mapping_length;
+  unsigned int* words = (unsigned int*) MapTableFile(filename, populate, advice, &mapping_length);
+  unsigned int interval_table_size = words[0];
+  if (((size_t) interval_table_size + 1) * sizeof(unsigned int) > mapping_length) {
+    std::cerr << "Truncated interval table " << filename << std::endl;
+    exit(1);
+  }
+  interval_table->ptr = words + 1;
+  interval_table->length = interval_table_size;
+  interval_table->mapping = words;
+  interval_table->mapping_length = mapping_length;
+  interval_table->pages = PAGES_DEFAULT;
+  interval_table->step = 1;
+}
+
+/* Maps the position table in the given file. The table points into the
+ * mapping just past the reference and seed length header.
+ */
+void MapPositionTable (char* filename, table* position_table, bool populate, int advice) {
+  *position_table = table();
+  size_t mapping_length;
+  unsigned int* words = (unsigned int*) MapTableFile(filename, populate, advice, &mapping_length);
+  CheckFormatFlags(filename, words[1], POSITIONS_RAW);
+  unsigned int position_table_length = PositionTableLength(words[0], words[1], position_table);
+  if (((size_t) position_table_length + 2) * sizeof(unsigned int) > mapping_length) {
+    std::cerr << "Truncated position table " << filename << std::endl;
+    exit(1);
+  }
+  position_table->ptr = words + 2;
+  position_table->length = position_table_length;
+  position_table->mapping = words;
+  position_table->mapping_length = mapping_length;
+  position_table->pages = PAGES_DEFAULT;
+  position_table->format = POSITIONS_RAW;
+}
+
+/* Maps the bit-packed position table in the given file. The table points
+ * into the mapping just past the header and the bits per position.
+ */
+void MapPackedPositionTable (char* filename, table* position_table, bool populate, int advice) {
+  *position_table = table();
+  size_t mapping_length;
+  unsigned int* words = (unsigned int*) MapTableFile(filename, populate, advice, &mapping_length);
+  if (mapping_length < 3 * sizeof(unsigned int)) {
+    std::cerr << "Truncated position table " << filename << std::endl;
+    exit(1);
+  }
+  CheckFormatFlags(filename, words[1], POSITIONS_PACKED);
+  unsigned int position_table_length = PositionTableLength(words[0], words[1], position_table);
+  unsigned int packed_words = PackedTableWords(filename, position_table_length, words[2]);
+  if (((size_t) packed_words + 3) * sizeof(unsigned int) > mapping_length) {
+    std::cerr << "Truncated position table " << filename << std::endl;
+    exit(1);
+  }
+  position_table->ptr = words + 3;
+  position_table->length = packed_words;
+  position_table->mapping = words;
+  position_table->mapping_length = mapping_length;
+  position_table->pages = PAGES_DEFAULT;
+  position_table->format = POSITIONS_PACKED;
+  position_table->bits = words[2];
+}
+
+/* Maps the Elias-Fano position table in the given file. The table points
+ * into the mapping just past the reference and seed length header.
+ */
+void MapEliasFanoPositionTable (char* filename, table* position_table, bool populate, int advice) {
+  *position_table = table();
+  size_t mapping_length;
+  unsigned int* words = (unsigned int*) MapTableFile(filename, populate, advice, &mapping_length);
+  if (mapping_length < 2 * sizeof(unsigned int) + sizeof(elias_fano_header)) {
+    std::cerr << "Truncated position table " << filename << std::endl;
+    exit(1);
+  }
+  CheckFormatFlags(filename, words[1], POSITIONS_ELIAS_FANO);
+  PositionTableLength(words[0], words[1], position_table);
+  position_table->ptr = words + 2;
+  position_table->length = (unsigned int) ((mapping_length - 2 * sizeof(unsigned int)) / sizeof(unsigned int));
+  position_table->mapping = words;
+  position_table->mapping_length = mapping_length;
+  position_table->pages = PAGES_DEFAULT;
+  position_table->format = POSITIONS_ELIAS_FANO;
+  position_table->bits = ((elias_fano_header*) position_table->ptr)->low_bits;
+}
+
+/* Maps the compressed position table in the given file. The table points
+ * into the mapping just past the reference and seed length header.
+ */
+void MapVarintPositionTable (char* filename, table* position_table, bool populate, int advice) {
+  *position_table = table();
+  size_t mapping_length;
+  unsigned int* words = (unsigned int*) MapTableFile(filename, populate, advice, &mapping_length);
+  if (mapping_length < 2 * sizeof(unsigned int)) {
+    std::cerr << "Truncated position table " << filename << std::endl;
+    exit(1);
+  }
+  position_table->ptr = words + 2;
+  position_table->length = (unsigned int) ((mapping_length - 2 * sizeof(unsigned int) + sizeof(unsigned int) - 1)
+                                           / sizeof(unsigned int));
+  position_table->stream_bytes = mapping_length - 2 * sizeof(unsigned int);
+  position_table->mapping = words;
+  position_table->mapping_length = mapping_length;
+  position_table->pages = PAGES_DEFAULT;
+  position_table->step = 1;
+  position_table->format = POSITIONS_VARINT;
+}
+
+/* Maps the hash table in the given file. The table points into the mapping
+ * just past the slot count and seed length header.
+ */
+void MapHashTable (char* filename, unsigned int seed_length, table* hash_table, bool populate, int advice) {
+  *hash_table = table();
+  size_t mapping_length;
+  unsigned int* words = (unsigned int*) MapTableFile(filename, populate, advice, &mapping_length);
+  CheckHashHeader(filename, words[0], words[1], seed_length);
+  unsigned int hash_table_words = (unsigned int) (HASH_SLOT_WORDS << words[0]);
+  if (((size_t) hash_table_words + 2) * sizeof(unsigned int) > mapping_length) {
+    std::cerr << "Truncated hash table " << filename << std::endl;
+    exit(1);
+  }
+  hash_table->ptr = words + 2;
+  hash_table->length = hash_table_words;
+  hash_table->mapping = words;
+  hash_table->mapping_length = mapping_length;
+  hash_table->pages = PAGES_DEFAULT;
+  hash_table->step = 1;
+}
+
+/* Reads in the packed reference sequence from the given filename, followed
+ * by REFERENCE_PADDING zero bytes.
+ */
+#define REFERENCE_PADDING 16
+void ReadReference (char* filename, reference* ref) {
+  std::ifstream ref_seq_file;
+  ref_seq_file.open(filename);
+  if (!ref_seq_file.is_open()) {
+    std::cerr << "Could not open " << filename << std::endl;
+    exit(1);
+  }
+  ref_seq_file.read((char *)(&ref->length), sizeof(unsigned int));
+  size_t ref_seq_bytes = ((size_t) ref->length + 3) / 4;
+  ref->ptr = new unsigned char[ref_seq_bytes + REFERENCE_PADDING]();
+  ref_seq_file.read((char *)(ref->ptr), ref_seq_bytes);
+  ref_seq_file.close();
+}
+
+void FreeReference (reference* ref) {
+  delete[] ref->ptr;
+  ref->ptr = NULL;
+}
+
+void FreeTable (table* t) {
+  if (t->mapping != NULL) {
+    munmap(t->mapping, t->mapping_length);
+  } else {
+    delete[] t->ptr;
+  }
+  t->ptr = NULL;
+  t->mapping = NULL;
+  t->mapping_length = 0;
+}
@@ -1,12 +1,115 @@
 #ifndef _table_io_h
 #define _table_io_h
 
+#include <stddef.h>
+
+// Page backing for tables copied into memory by Read*Table(). The interval
+// table is indexed at random, so with 4 KB pages nearly every lookup also
+// misses the TLB; huge pages let a few hundred TLB entries cover gigabytes.
+enum table_pages {
+  PAGES_DEFAULT,   // operator new, normally 4 KB pages
+  PAGES_THP,       // anonymous memory hinted with MADV_HUGEPAGE
+  PAGES_2M,        // MAP_HUGETLB 2 MB pages from the reserved pool
+  PAGES_1G         // MAP_HUGETLB 1 GB pages from the reserved pool
+};
+
+// Returns the name of a page backing as used by --hugepages.
+const char* TablePagesName (table_pages pages);
+
+// Encoding of a position table, chosen with --positions.
+enum position_format {
+  POSITIONS_RAW,      // gen_tables: one 32-bit word per position
+  POSITIONS_VARINT,   // gen_tables_compressed type 1: byte stream, see varint_positions.h
+  POSITIONS_PACKED,   // gen_tables --packed: fixed bits per position, see packed_positions.h
+  POSITIONS_ELIAS_FANO  // gen_tables --elias-fano: see elias_fano.h
+};
+
+// Returns the name of a position table encoding as used by --positions.
+const char* PositionFormatName (position_format format);
+
+// A loaded table. The loaders and CopyTable() value-initialize it first, so
+// fields its kind or format does not use read as zero.
 struct table {
   unsigned int  length;
   unsigned int* ptr;
+  // Mapping backing ptr when the table was loaded with Map*Table() or read
+  // into huge pages, NULL when ptr was allocated with operator new.
+  void*         mapping;
+  size_t        mapping_length;
+  table_pages   pages;        // backing actually obtained
+  // Position tables only: positions are kept for every step-th reference
+  // offset (gen_tables --sample); 1 for a full table
+  unsigned int  step;
+  position_format format;     // position tables only: encoding of ptr
+  unsigned int  bits;         // POSITIONS_PACKED: bits per position; POSITIONS_ELIAS_FANO: low bits
+  size_t        stream_bytes; // POSITIONS_VARINT: exact length of the byte stream
+};
+
+// A sampled position table stores its step in the upper bits of the seed
+// length word of its header
+#define POSITION_STEP_SHIFT 16
+#define POSITION_SEED_MASK ((1U << POSITION_STEP_SHIFT) - 1)
+// and a bit-packed or Elias-Fano coded one sets one of its top two bits
+#define POSITION_PACKED_FLAG 0x80000000U
+#define POSITION_ELIAS_FANO_FLAG 0x40000000U
+#define POSITION_FORMAT_FLAGS (POSITION_PACKED_FLAG | POSITION_ELIAS_FANO_FLAG)
+
+// A 2-bit packed reference sequence as written by gen_ref_seq and
+// ref_ascii_to_binary. ptr is padded with zero bytes so that word-sized
+// reads near the end stay in bounds.
+struct reference {
+  unsigned int   length;
+  unsigned char* ptr;
 };
 
-void ReadIntervalTable (char* filename, table* interval_table);
-void ReadPositionTable (char* filename, table* position_table);
+// Reads a table file into memory backed by the requested pages. A huge page
+// request that cannot be met falls back to the next smaller kind (1 GB to
+// 2 MB to transparent huge pages to the default); the table's pages field
+// says which was used.
+void ReadIntervalTable (char* filename, table* interval_table, table_pages pages);
+void ReadPositionTable (char* filename, table* position_table, table_pages pages);
+
+// Zero-copy alternatives to the Read*Table() routines: the table file is
+// mapped read-only and ptr points straight into the mapping, so loading is
+// near-instant and processes on the same host share the page cache. If
+// populate is set the whole file is faulted in up front (MAP_POPULATE);
+// advice is passed to madvise() (MADV_NORMAL leaves the kernel default).
+void MapIntervalTable (char* filename, table* interval_table, bool populate, int advice);
+void MapPositionTable (char* filename, table* position_table, bool populate, int advice);
+
+// Reads or maps the hash seed index written by gen_hash_tables. ptr points
+// at its hash_slot array and length counts the array in table words. Exits
+// with a message if the table was built for another seed length.
+void ReadHashTable (char* filename, unsigned int seed_length, table* hash_table, table_pages pages);
+void MapHashTable (char* filename, unsigned int seed_length, table* hash_table, bool populate, int advice);
+
+// Reads or maps a compressed position table written by gen_tables_compressed
+// type 1. ptr points at the byte stream and length counts it in table words,
+// rounded up; stream_bytes gives its exact length.
+void ReadVarintPositionTable (char* filename, table* position_table, table_pages pages);
+void MapVarintPositionTable (char* filename, table* position_table, bool populate, int advice);
+
+// Reads or maps a bit-packed position table written by gen_tables --packed.
+// ptr points at the packed stream and length counts it, padding included,
+// in table words. Exits with a message if the file is not bit-packed.
+void ReadPackedPositionTable (char* filename, table* position_table, table_pages pages);
+void MapPackedPositionTable (char* filename, table* position_table, bool populate, int advice);
+
+// Reads or maps an Elias-Fano position table written by gen_tables
+// --elias-fano. ptr points at its elias_fano_header and length counts the
+// coded sections in table words; EliasFanoView() makes sense of them.
+void ReadEliasFanoPositionTable (char* filename, table* position_table, table_pages pages);
+void MapEliasFanoPositionTable (char* filename, table* position_table, bool populate, int advice);
+
+// Copies src into newly allocated memory backed by the requested pages.
+// The pages are placed by the calling thread's memory policy, since the
+// copy is what first touches them.
+void CopyTable (const table* src, table_pages pages, table* dst);
+
+// Releases a table loaded by any of the routines above.
+void FreeTable (table* t);
+
+void ReadReference (char* filename, reference* ref);
+void FreeReference (reference* ref);
 
 #endif
@@ -0,0 +1,136 @@
+// Work-stealing batch scheduler used by the multi-threaded baseline
+
+#include <pthread.h>
+#include <sched.h>
+#include "thread_pool.h"
+
+// Restricts the calling thread to a set of CPUs; does nothing if it is empty
+static void PinCurrentThread(const std::vector<int>& cpus) {
+  if (cpus.empty()) {
+    return;
+  }
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int cpu : cpus) {
+    CPU_SET(cpu, &set);
+  }
+  pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+WorkStealingPool::WorkStealingPool(unsigned int num_threads, const std::vector<std::vector<int> >& worker_cpus) {
+  num_threads_ = (num_threads == 0) ? 1 : num_threads;
+  for (unsigned int i = 0; i < num_threads_; i++) {
+    queues_.push_back(new WorkQueue);
+  }
+  worker_cpus_ = worker_cpus;
+  worker_cpus_.resize(num_threads_);
+  task_ = NULL;
+  run_id_ = 0;
+  busy_workers_ = 0;
+  stopping_ = false;
+
+  PinCurrentThread(worker_cpus_[0]);
+  for (unsigned int i = 1; i < num_threads_; i++) {
+    workers_.push_back(std::thread(&WorkStealingPool::Worker, this, i));
+  }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+  {
+    std::lock_guard<std::mutex> guard(run_lock_);
+    stopping_ = true;
+  }
+  run_start_.notify_all();
+  for (unsigned int i = 0; i < workers_.size(); i++) {
+    workers_[i].join();
+  }
+  for (unsigned int i = 0; i < num_threads_; i++) {
+    delete queues_[i];
+  }
+}
+
+unsigned int WorkStealingPool::num_threads() {
+  return num_threads_;
+}
+
+void WorkStealingPool::Run(unsigned int num_batches, const Task& task) {
+  // Hand out contiguous ranges so that neighbouring batches stay on the same
+  // core unless they get stolen.
+  for (unsigned int i = 0; i < num_threads_; i++) {
+    unsigned int first = (unsigned int) ((unsigned long long) num_batches * i / num_threads_);
+    unsigned int last = (unsigned int) ((unsigned long long) num_batches * (i + 1) / num_threads_);
+    std::lock_guard<std::mutex> guard(queues_[i]->lock);
+    for (unsigned int b = first; b < last; b++) {
+      queues_[i]->batches.push_back(b);
+    }
+  }
+
+  if (!workers_.empty()) {
+    {
+      std::lock_guard<std::mutex> guard(run_lock_);
+      task_ = &task;
+      busy_workers_ = (unsigned int) workers_.size();
+      run_id_++;
+    }
+    run_start_.notify_all();
+  }
+  Drain(0, &task);
+  if (!workers_.empty()) {
+    std::unique_lock<std::mutex> lock(run_lock_);
+    run_done_.wait(lock, [this]() { return busy_workers_ == 0; });
+    task_ = NULL;
+  }
+}
+
+bool WorkStealingPool::NextBatch(unsigned int thread, unsigned int* batch) {
+  {
+    WorkQueue* own = queues_[thread];
+    std::lock_guard<std::mutex> guard(own->lock);
+    if (!own->batches.empty()) {
+      *batch = own->batches.front();
+      own->batches.pop_front();
+      return true;
+    }
+  }
+  for (unsigned int i = 1; i < num_threads_; i++) {
+    WorkQueue* victim = queues_[(thread + i) % num_threads_];
+    std::lock_guard<std::mutex> guard(victim->lock);
+    if (!victim->batches.empty()) {
+      *batch = victim->batches.back();
+      victim->batches.pop_back();
+      return true;
+    }
+  }
+  return false;
+}
+
+void WorkStealingPool::Drain(unsigned int thread, const Task* task) {
+  unsigned int batch;
+  while (NextBatch(thread, &batch)) {
+    (*task)(batch, thread);
+  }
+}
+
+void WorkStealingPool::Worker(unsigned int thread) {
+  PinCurrentThread(worker_cpus_[thread]);
+  unsigned long long last_run = 0;
+  while (true) {
+    const Task* task;
+    {
+      std::unique_lock<std::mutex> lock(run_lock_);
+      run_start_.wait(lock, [&]() { return stopping_ || run_id_ != last_run; });
+      if (stopping_) {
+        return;
+      }
+      last_run = run_id_;
+      task = task_;
+    }
+    Drain(thread, task);
+    {
+      std::lock_guard<std::mutex> guard(run_lock_);
+      if (--busy_workers_ == 0) {
+        run_done_.notify_one();
+      }
+    }
+  }
+}
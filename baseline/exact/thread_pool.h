@@ -0,0 +1,71 @@
+#ifndef _thread_pool_h
+#define _thread_pool_h
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runs a fixed set of numbered batches across worker threads. Each worker
+// starts with a contiguous range of batches in its own deque and takes work
+// from the front; once that runs dry it steals from the back of the other
+// workers' deques, so a few batches full of repeat seeds cannot leave the
+// remaining threads idle.
+//
+// The worker threads are started once and wait on a condition variable
+// between Run() calls, so a run over a small chunk does not pay for thread
+// creation.
+class WorkStealingPool {
+ public:
+  typedef std::function<void (unsigned int batch, unsigned int thread)> Task;
+
+  // Starts the workers. If worker_cpus is given, worker t is restricted to
+  // the CPUs in worker_cpus[t] (none if that is empty). Worker 0 is the
+  // thread constructing the pool, which must also be the one calling Run();
+  // it is pinned here and stays pinned afterwards.
+  WorkStealingPool(unsigned int num_threads,
+                   const std::vector<std::vector<int> >& worker_cpus = std::vector<std::vector<int> >());
+  ~WorkStealingPool();
+
+  // Calls task once for every batch in [0, num_batches) and returns when all
+  // calls have finished. The calling thread acts as worker 0. The thread
+  // index passed to task is in [0, num_threads()) and is stable for the
+  // duration of the call, so it may be used to index per-thread state.
+  void Run(unsigned int num_batches, const Task& task);
+
+  unsigned int num_threads();
+
+ private:
+  struct WorkQueue {
+    std::mutex lock;
+    std::deque<unsigned int> batches;
+  };
+
+  // Takes the next batch for the given worker, stealing if its own queue is
+  // empty. Returns false once no work remains anywhere.
+  bool NextBatch(unsigned int thread, unsigned int* batch);
+
+  // Runs batches on the given worker until none are left
+  void Drain(unsigned int thread, const Task* task);
+
+  // Body of worker threads 1 .. num_threads - 1
+  void Worker(unsigned int thread);
+
+  unsigned int num_threads_;
+  std::vector<WorkQueue*> queues_;
+  std::vector<std::vector<int> > worker_cpus_;  // empty = unpinned
+  std::vector<std::thread> workers_;
+
+  // Guards the fields below, which hand a run to the waiting workers
+  std::mutex run_lock_;
+  std::condition_variable run_start_;
+  std::condition_variable run_done_;
+  const Task* task_;
+  unsigned long long run_id_;   // bumped by every Run()
+  unsigned int busy_workers_;   // workers still draining the current run
+  bool stopping_;
+};
+
+#endif
@@ -0,0 +1,198 @@
+// Decodes and intersects varint compressed position lists for --positions varint
+
+#include <stdint.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#include "varint_positions.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+// The SSSE3 block decoder below exists on x86 only; elsewhere lists are
+// always decoded a byte at a time.
+
+// pshufb patterns that move each of four gaps of 1-4 bytes into its own
+// 32-bit lane, zero filled. Indexed by the four gap lengths minus one, two
+// bits each, first gap lowest.
+static __m128i gap_shuffle_table[256];
+
+static bool InitGapShuffleTable () {
+  for (unsigned int key = 0; key < 256; key++) {
+    uint8_t bytes[16];
+    unsigned int start = 0;
+    for (unsigned int lane = 0; lane < 4; lane++) {
+      unsigned int length = ((key >> (2 * lane)) & 3) + 1;
+      for (unsigned int b = 0; b < 4; b++) {
+        bytes[lane * 4 + b] = (b < length) ? start + b : 0x80;
+      }
+      start += length;
+    }
+    gap_shuffle_table[key] = _mm_loadu_si128((const __m128i*) bytes);
+  }
+  return true;
+}
+
+static bool gap_shuffle_table_ready = InitGapShuffleTable();
+
+/* Decodes the four gaps at the start of 16 readable bytes and writes base
+ * plus their running sums to positions. Returns false, having written
+ * nothing, if a gap is longer than four bytes; otherwise sets *used to the
+ * bytes the four gaps took.
+ */
+__attribute__((target("ssse3")))
+static bool DecodeGapsSsse3 (const unsigned char* bytes, unsigned int base, unsigned int* positions,
+                             unsigned int* used) {
+  __m128i block = _mm_loadu_si128((const __m128i*) bytes);
+  unsigned int terminators = _mm_movemask_epi8(block);
+  unsigned int key = 0;
+  unsigned int length_sum = 0;
+  for (unsigned int lane = 0; lane < 4; lane++) {
+    unsigned int rest = terminators >> length_sum;
+    if ((rest & 0xF) == 0) {
+      return false;
+    }
+    unsigned int length = __builtin_ctz(rest) + 1;
+    key |= (length - 1) << (2 * lane);
+    length_sum += length;
+  }
+  __m128i lanes = _mm_shuffle_epi8(block, gap_shuffle_table[key]);
+  // Join the 7-bit groups of each lane: byte b moves down b bits
+  __m128i gaps = _mm_and_si128(lanes, _mm_set1_epi32(0x7F));
+  gaps = _mm_or_si128(gaps, _mm_srli_epi32(_mm_and_si128(lanes, _mm_set1_epi32(0x7F00)), 1));
+  gaps = _mm_or_si128(gaps, _mm_srli_epi32(_mm_and_si128(lanes, _mm_set1_epi32(0x7F0000)), 2));
+  gaps = _mm_or_si128(gaps, _mm_srli_epi32(_mm_and_si128(lanes, _mm_set1_epi32(0x7F000000)), 3));
+  // Prefix sum over the four lanes
+  gaps = _mm_add_epi32(gaps, _mm_slli_si128(gaps, 4));
+  gaps = _mm_add_epi32(gaps, _mm_slli_si128(gaps, 8));
+  _mm_storeu_si128((__m128i*) positions, _mm_add_epi32(gaps, _mm_set1_epi32(base)));
+  *used = length_sum;
+  return true;
+}
+#endif
+
+/* Decodes one gap a byte at a time, advancing *next. Stops at end if the
+ * stream is cut short.
+ */
+static inline unsigned int ScalarGap (const unsigned char** next, const unsigned char* end) {
+  unsigned int gap = 0;
+  unsigned int shift = 0;
+  while (*next < end) {
+    unsigned char byte = *(*next)++;
+    gap |= (unsigned int) (byte & 0x7F) << shift;
+    if (byte & 0x80) {
+      break;
+    }
+    shift += 7;
+  }
+  return gap;
+}
+
+// Decoding state of one compressed list
+struct varint_cursor {
+  const unsigned char* next;
+  const unsigned char* end;
+  unsigned int position;       // last position decoded
+};
+
+/* Decodes up to four more positions into block and returns how many, 0 at
+ * the end of the list.
+ */
+static unsigned int NextBlock (varint_cursor* cursor, unsigned int* block, bool simd) {
+#if defined(__x86_64__) || defined(__i386__)
+  unsigned int used;
+  if (simd && cursor->end - cursor->next >= 16 && DecodeGapsSsse3(cursor->next, cursor->position, block, &used)) {
+    cursor->next += used;
+    cursor->position = block[3];
+    return 4;
+  }
+#endif
+  unsigned int count = 0;
+  while (count < 4 && cursor->next < cursor->end) {
+    cursor->position += ScalarGap(&cursor->next, cursor->end);
+    block[count++] = cursor->position;
+  }
+  return count;
+}
+
+/* Points cursor at a list and returns its raw first position in *first.
+ * Returns false if the list is empty.
+ */
+static bool StartList (const unsigned char* stream, unsigned int num_bytes, varint_cursor* cursor,
+                       unsigned int* first) {
+  if (num_bytes < sizeof(unsigned int)) {
+    return false;
+  }
+  memcpy(first, stream, sizeof(unsigned int));
+  cursor->next = stream + sizeof(unsigned int);
+  cursor->end = stream + num_bytes;
+  cursor->position = *first;
+  return true;
+}
+
+static bool UseSimd (merge_backend backend) {
+#if defined(__x86_64__) || defined(__i386__)
+  return backend != MERGE_SCALAR && __builtin_cpu_supports("ssse3");
+#else
+  return false;
+#endif
+}
+
+const char* VarintDecoderName (merge_backend backend) {
+  return UseSimd(backend) ? "ssse3" : "scalar";
+}
+
+unsigned int DecodeVarintList (const unsigned char* stream, unsigned int num_bytes, unsigned int offset,
+                               unsigned int* out, merge_backend backend) {
+  varint_cursor cursor;
+  unsigned int block[4];
+  if (!StartList(stream, num_bytes, &cursor, &block[0])) {
+    return 0;
+  }
+  bool simd = UseSimd(backend);
+  unsigned int count = 0;
+  unsigned int n = 1;
+  do {
+    for (unsigned int k = 0; k < n; k++) {
+      if (block[k] >= offset) {
+        out[count++] = block[k] - offset;
+      }
+    }
+    n = NextBlock(&cursor, block, simd);
+  } while (n > 0);
+  return count;
+}
+
+unsigned int IntersectVarintList (const unsigned int* list1, unsigned int length1, const unsigned char* stream,
+                                  unsigned int num_bytes, unsigned int offset, unsigned int* result,
+                                  merge_backend backend, unsigned int* bytes_read) {
+  varint_cursor cursor;
+  unsigned int block[4];
+  *bytes_read = 0;
+  if (length1 == 0 || !StartList(stream, num_bytes, &cursor, &block[0])) {
+    return 0;
+  }
+  bool simd = UseSimd(backend);
+  unsigned int ptr1 = 0;
+  unsigned int count = 0;
+  unsigned int n = 1;
+  while (n > 0 && ptr1 < length1) {
+    for (unsigned int k = 0; k < n && ptr1 < length1; k++) {
+      if (block[k] < offset) {
+        continue;
+      }
+      unsigned int target = block[k] - offset;
+      while (ptr1 < length1 && list1[ptr1] < target) {
+        ptr1++;
+      }
+      if (ptr1 < length1 && list1[ptr1] == target) {
+        result[count++] = target;
+        ptr1++;
+      }
+    }
+    if (ptr1 < length1) {
+      n = NextBlock(&cursor, block, simd);
+    }
+  }
+  *bytes_read = cursor.next - stream;
+  return count;
+}
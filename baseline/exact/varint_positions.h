@@ -0,0 +1,39 @@
+#ifndef _varint_positions_h
+#define _varint_positions_h
+
+#include "merge.h"
+
+// Position lists compressed by gen_tables_compressed type 1 (compress2),
+// read with --positions varint. Each list is its first position as a raw
+// 4-byte word followed by the gaps between consecutive positions, 7 bits
+// per byte, least significant group first, with the top bit set on the last
+// byte of each gap. An empty list has no bytes. The interval table holds
+// byte offsets into the stream instead of position indices, so the byte
+// length of a list bounds its number of positions.
+//
+// The SIMD decoder handles four gaps of up to four bytes (gaps below 2^28)
+// per step: the terminator bits of 16 bytes locate the four gaps, a shuffle
+// spreads their bytes into one 32-bit lane each, the 7-bit groups are
+// joined with shifts and a prefix sum turns the gaps into positions. Longer
+// gaps and list tails of under 16 bytes are decoded a byte at a time.
+
+// Decodes a num_bytes-byte list, writing p - offset for every position
+// p >= offset to out and returning how many were written. out must have
+// room for num_bytes + MERGE_RESULT_PADDING entries.
+unsigned int DecodeVarintList (const unsigned char* stream, unsigned int num_bytes, unsigned int offset,
+                               unsigned int* out, merge_backend backend);
+
+// Intersects a sorted list1 with a num_bytes-byte compressed list2 whose
+// positions lie offset ahead, like merge(). list2 is decoded a block at a
+// time inside the merge loop and never materialized, and decoding stops as
+// soon as list1 is exhausted. Sets *bytes_read to the bytes of list2 that
+// were decoded.
+unsigned int IntersectVarintList (const unsigned int* list1, unsigned int length1, const unsigned char* stream,
+                                  unsigned int num_bytes, unsigned int offset, unsigned int* result,
+                                  merge_backend backend, unsigned int* bytes_read);
+
+// Returns the name of the decoder the given --merge backend resolves to on
+// this CPU: "ssse3" for any SIMD backend when available, else "scalar".
+const char* VarintDecoderName (merge_backend backend);
+
+#endif
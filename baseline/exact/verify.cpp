@@ -0,0 +1,42 @@
+// Verifies candidate alignments directly against the packed reference
+
+#include <string.h>
+#include "verify.h"
+
+uint64_t PackedWindow (const unsigned char* seq, uint64_t position) {
+  const unsigned char* bytes = seq + position / 4;
+  unsigned int shift = (position % 4) * 2;
+  uint64_t word;
+  memcpy(&word, bytes, sizeof(uint64_t));
+  word = __builtin_bswap64(word);
+  if (shift != 0) {
+    word = (word << shift) | (bytes[8] >> (8 - shift));
+  }
+  return word;
+}
+
+void PackQueryWords (const unsigned char* query, unsigned int num_nucleotides, uint64_t* words) {
+  unsigned int num_words = (num_nucleotides + NUCLEOTIDES_PER_WORD - 1) / NUCLEOTIDES_PER_WORD;
+  for (unsigned int w = 0; w < num_words; w++) {
+    words[w] = PackedWindow(query, (uint64_t) w * NUCLEOTIDES_PER_WORD);
+  }
+}
+
+bool VerifyCandidate (reference* ref, uint64_t position, const uint64_t* query_words, unsigned int num_nucleotides) {
+  if (position + num_nucleotides > ref->length) {
+    return false;
+  }
+  for (unsigned int n = 0; n < num_nucleotides; n += NUCLEOTIDES_PER_WORD) {
+    uint64_t diff = PackedWindow(ref->ptr, position + n) ^ query_words[n / NUCLEOTIDES_PER_WORD];
+    unsigned int remaining = num_nucleotides - n;
+    if (remaining < NUCLEOTIDES_PER_WORD) {
+      diff &= ~(~0ULL >> (remaining * 2));
+    }
+    // Fold each 2-bit nucleotide difference into its low bit
+    unsigned int mismatches = __builtin_popcountll((diff | (diff >> 1)) & 0x5555555555555555ULL);
+    if (mismatches != 0) {
+      return false;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,26 @@
+#ifndef _verify_h
+#define _verify_h
+
+#include <stdint.h>
+#include "table_io.h"
+
+// Number of nucleotides packed into each verification word
+#define NUCLEOTIDES_PER_WORD 32
+
+// Returns the 32 nucleotides starting at nucleotide index position of a
+// 2-bit packed sequence (first nucleotide in the top bits of each byte, as
+// written by the generation tools) as one word, first nucleotide in the top
+// two bits. The sequence must be readable for 9 bytes from position / 4.
+uint64_t PackedWindow (const unsigned char* seq, uint64_t position);
+
+// Splits the first num_nucleotides nucleotides of a packed query into
+// ceil(num_nucleotides / 32) words with PackedWindow().
+void PackQueryWords (const unsigned char* query, unsigned int num_nucleotides, uint64_t* words);
+
+// Returns true if the reference matches the packed query words over
+// num_nucleotides nucleotides starting at position. Each word is compared
+// with one XOR; popcount of the folded difference counts the mismatching
+// nucleotides, and the first mismatch ends the comparison.
+bool VerifyCandidate (reference* ref, uint64_t position, const uint64_t* query_words, unsigned int num_nucleotides);
+
+#endif
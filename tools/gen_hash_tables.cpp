@@ -0,0 +1,167 @@
+/* Generates a hash seed index and its position table, for seed lengths up
+ * to 32 where the dense 4^k interval table of gen_tables does not fit.
+ *
+ * The position table has the same format as the one written by gen_tables:
+ * the reference and seed length, then the N-k+1 reference positions with
+ * the positions of each seed grouped together and sorted. Groups appear in
+ * hash table slot order rather than seed order.
+ *
+ * The hash table stores only the seeds that occur in the reference, in an
+ * open-addressing table of 2^b slots (at most half full, linear probing).
+ * Each slot is 16 bytes: the seed packed 2 bits per nucleotide into a 64-bit
+ * word, then the 32-bit start and end of its positions in the position
+ * table. Empty slots have start == end. File format:
+ *   log2 of the slot count, b (4 bytes)
+ *   Seed length               (4 bytes)
+ *   Slots                     (16 bytes each)
+ *
+ * NOTE: Positions are 32-bit, and the baseline addresses at most 2^29 slots
+ *       (MAX_HASH_SLOT_BITS), so at most 2^28 distinct seeds can be indexed. Memory use is about
+ *       4N bytes for the position table plus 32 bytes per distinct seed.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
+#include <stdint.h>
+#include <vector>
+#include "../baseline/exact/hash_format.h"
+
+#define MAX_SEED_LENGTH 32
+#define MIN_SLOT_BITS 16
+
+/* Returns the slot holding seed, or the empty slot where it belongs. While
+ * building, a slot is empty when its end (used as the seed's count) is 0.
+ */
+hash_slot* find_slot(std::vector<hash_slot>& slots, unsigned int slot_bits, uint64_t seed) {
+  uint64_t mask = slots.size() - 1;
+  uint64_t s = HashSeedSlot(seed, slot_bits);
+  while (slots[s].end != 0 && slots[s].seed != seed) {
+    s = (s + 1) & mask;
+  }
+  return &slots[s];
+}
+
+/* Returns the 2-bit code of nucleotide i of a packed reference sequence.
+ */
+unsigned int nucleotide_at(unsigned char* ref, unsigned int i) {
+  return (ref[i/4] >> ((3 - i%4) * 2)) & 3;
+}
+
+int main (int argc , char** argv) {
+  if (argc < 5) {
+    std::cout << "Usage: " << argv[0] << " <Ref Seq Filename> <Seed Length (<=32)> <Hash Table Filename> <Position Table Filename>" << std::endl;
+    exit(1);
+  }
+
+  unsigned int seed_length = (unsigned int) atoi(argv[2]);
+  if (seed_length == 0 || seed_length > MAX_SEED_LENGTH) {
+    std::cout << "Seed length must be 1 to " << MAX_SEED_LENGTH << std::endl;
+    exit(1);
+  }
+  uint64_t seed_mask = (seed_length < MAX_SEED_LENGTH) ? (1ULL << (2 * seed_length)) - 1 : ~0ULL;
+
+  // Read the reference sequence
+  std::cout << "Reading reference sequence" << std::endl;
+  unsigned int ref_seq_length;
+  std::ifstream ref_seq_file;
+  ref_seq_file.open(argv[1]);
+  ref_seq_file.read((char *)(&ref_seq_length), sizeof(unsigned int));
+  unsigned int ref_seq_bytes = (ref_seq_length + 3) / 4;
+  unsigned char* ref = new unsigned char[ref_seq_bytes];
+  ref_seq_file.read((char *)ref, ref_seq_bytes * sizeof(unsigned char));
+  ref_seq_file.close();
+  if (ref_seq_length < seed_length) {
+    std::cout << "Reference is shorter than the seed length" << std::endl;
+    exit(1);
+  }
+
+  // Count the occurrences of each seed, doubling the table whenever it
+  // would become more than half full
+  std::cout << "Counting seeds" << std::endl;
+  unsigned int slot_bits = MIN_SLOT_BITS;
+  std::vector<hash_slot> slots((size_t) 1 << slot_bits, hash_slot());
+  uint64_t num_distinct = 0;
+  uint64_t seed = 0;
+  for (unsigned int i = 0; i < ref_seq_length; i++) {
+    if (i % 10000000 == 0) {
+      std::cout << "Seeds " << i << " out of " << ref_seq_length << std::endl;
+    }
+    seed = ((seed << 2) | nucleotide_at(ref, i)) & seed_mask;
+    if (i + 1 < seed_length) {
+      continue;
+    }
+    hash_slot* slot = find_slot(slots, slot_bits, seed);
+    if (slot->end == 0) {
+      slot->seed = seed;
+      num_distinct++;
+    }
+    slot->end++;
+    if (2 * num_distinct > slots.size()) {
+      if (slot_bits == MAX_HASH_SLOT_BITS) {
+        std::cout << "Too many distinct seeds for a 2^" << MAX_HASH_SLOT_BITS << " slot table" << std::endl;
+        exit(1);
+      }
+      std::vector<hash_slot> old_slots;
+      old_slots.swap(slots);
+      slot_bits++;
+      slots.assign((size_t) 1 << slot_bits, hash_slot());
+      for (size_t s = 0; s < old_slots.size(); s++) {
+        if (old_slots[s].end != 0) {
+          *find_slot(slots, slot_bits, old_slots[s].seed) = old_slots[s];
+        }
+      }
+    }
+  }
+  std::cout << num_distinct << " distinct seeds in " << slots.size() << " slots" << std::endl;
+
+  // Turn the counts into position table intervals, in slot order. end is
+  // left at start and advanced as positions are filled in below.
+  uint32_t next_start = 0;
+  for (size_t s = 0; s < slots.size(); s++) {
+    uint32_t count = slots[s].end;
+    slots[s].start = next_start;
+    slots[s].end = next_start;
+    next_start += count;
+  }
+
+  // Compute position table
+  std::cout << "Computing position table" << std::endl;
+  unsigned int position_table_length = ref_seq_length - seed_length + 1;
+  unsigned int* position_table = new unsigned int[position_table_length];
+  seed = 0;
+  for (unsigned int i = 0; i < ref_seq_length; i++) {
+    if (i % 10000000 == 0) {
+      std::cout << "Position table " << i << " out of " << ref_seq_length << std::endl;
+    }
+    seed = ((seed << 2) | nucleotide_at(ref, i)) & seed_mask;
+    if (i + 1 < seed_length) {
+      continue;
+    }
+    // Every seed is present, and linear probing never leaves an empty slot
+    // between a seed's home slot and its own, so matching the seed alone
+    // finds it (an empty slot's zero seed is never reached first)
+    uint64_t mask = slots.size() - 1;
+    uint64_t s = HashSeedSlot(seed, slot_bits);
+    while (slots[s].seed != seed) {
+      s = (s + 1) & mask;
+    }
+    position_table[slots[s].end++] = i + 1 - seed_length;
+  }
+
+  // Write hash table
+  std::cout << "Writing hash table" << std::endl;
+  std::ofstream hash_table_file(argv[3]);
+  hash_table_file.write((char *)(&slot_bits), sizeof(unsigned int));
+  hash_table_file.write((char *)(&seed_length), sizeof(unsigned int));
+  hash_table_file.write((char *) slots.data(), slots.size() * sizeof(hash_slot));
+  hash_table_file.close();
+
+  // Write position table
+  std::cout << "Writing position table" << std::endl;
+  std::ofstream position_table_file(argv[4]);
+  position_table_file.write((char *)(&ref_seq_length), sizeof(unsigned int));
+  position_table_file.write((char *)(&seed_length), sizeof(unsigned int));
+  position_table_file.write((char *)position_table, position_table_length * sizeof(unsigned int));
+  position_table_file.close();
+}
@@ -12,6 +12,24 @@
  * to each seed sequence. The interval table for the reference sequence TCGACGAT
  * with a 2-character seed length is [0 0 1 1 2 2 2 4 4 6 6 6 6 6 7 7].
  *
+ * With --sample S only the positions at every S-th reference offset (0, S,
+ * 2S, ...) are stored, shrinking the position table S times. The baseline
+ * then looks up every offset of a query and verifies candidates against the
+ * reference. A sampled position table records S in bits 16-29 of its seed
+ * length word, below the format flags, so S is at most 16383.
+ *
+ * With --packed each position table entry takes only the bits needed for
+ * the largest position, B = ceil(log2(N-k+1)), instead of 32. Entry i
+ * occupies bits [i*B, (i+1)*B) of a little-endian bit stream. The header
+ * sets the top bit of the seed length word and is followed by B (4 bytes);
+ * the stream is padded with at least 8 zero bytes to a multiple of 4 bytes.
+ * The interval table is the same either way.
+ *
+ * With --elias-fano the position table is instead one Elias-Fano coded
+ * increasing sequence of seed << B | position (layout in the baseline's
+ * elias_fano.h), with the top-but-one bit of the seed length word set.
+ * Entries keep their order, so the interval table is again unchanged.
+ *
  * NOTE: The program uses ~5 GB memory for seed length of 15 and ref length of 225M
  *       On a 12 GB machine, can't run more than seed length of 15.
  */
@@ -19,8 +37,21 @@
 #include <iostream>
 #include <fstream>
 #include <cstdlib>
+#include <cstring>
 #include <list>
 #include <cmath>
+#include <stdint.h>
+#include <vector>
+
+#define PACKED_FLAG 0x80000000U
+#define PACKED_PADDING 8
+#define ELIAS_FANO_FLAG 0x40000000U
+// The sample step sits between the seed length and the lowest format flag
+#define STEP_SHIFT 16
+#define MAX_SAMPLE_STEP ((ELIAS_FANO_FLAG >> STEP_SHIFT) - 1)
+#define EF_ONE_SAMPLE 64
+#define EF_ZERO_SAMPLE 256
+#define EF_MAX_LOW_BITS 56
 
 /* Converts a nucleotide sequence to an integer with the following encoding:
  * A : 00b
@@ -40,9 +71,130 @@ unsigned int seq2int(std::list<unsigned char>* seq) {
   return seq_int;
 }
 
+/* ORs value into a zeroed little-endian bit stream starting at the given
+ * bit. value has at most 56 bits, so shifted by the bit's offset within its
+ * byte it still fits in the 8 bytes starting there.
+ */
+void put_bits(unsigned char* stream, uint64_t bit, uint64_t value) {
+  uint64_t word;
+  memcpy(&word, stream + bit / 8, sizeof(word));
+  word |= value << (bit % 8);
+  memcpy(stream + bit / 8, &word, sizeof(word));
+}
+
+/* Packs length positions at bits bits each into a zeroed little-endian bit
+ * stream, padded to whole 4-byte words, and returns its size in bytes.
+ */
+size_t pack_positions(unsigned int* positions, unsigned int length, unsigned int bits, unsigned char** packed) {
+  size_t num_bytes = ((uint64_t) length * bits + 7) / 8 + PACKED_PADDING;
+  num_bytes = (num_bytes + 3) & ~(size_t) 3;
+  *packed = new unsigned char[num_bytes];
+  memset(*packed, 0, num_bytes);
+  for (unsigned int i = 0; i < length; i++) {
+    put_bits(*packed, (uint64_t) i * bits, positions[i]);
+  }
+  return num_bytes;
+}
+
+/* Writes the position table as an Elias-Fano sequence of the values
+ * seed << position_bits | position, where seed_ends[s] is the end of seed
+ * s's positions in the table. Each value's low bits are packed, its high
+ * part h at entry i sets bit h + i of the high bitvector, and the bit
+ * positions of every EF_ONE_SAMPLE-th one and EF_ZERO_SAMPLE-th zero are
+ * stored.
+ */
+void write_elias_fano(std::ofstream& file, unsigned int* positions, unsigned int length, unsigned int* seed_ends,
+                      unsigned int num_seeds, unsigned int position_bits) {
+  uint64_t universe = (uint64_t) num_seeds << position_bits;
+  unsigned int low_bits = 0;
+  while (length > 0 && low_bits < EF_MAX_LOW_BITS && ((uint64_t) length << (low_bits + 1)) <= universe) {
+    low_bits++;
+  }
+  std::cout << "Elias-Fano coding with " << low_bits << " low bits" << std::endl;
+
+  // The last value sizes the high bitvector: its seed is the first whose
+  // positions end at the end of the table
+  uint64_t last_value = 0;
+  if (length > 0) {
+    unsigned int last_seed = 0;
+    while (seed_ends[last_seed] < length) {
+      last_seed++;
+    }
+    last_value = ((uint64_t) last_seed << position_bits) | positions[length - 1];
+  }
+
+  // Low bits, with a spare word so the last entry can be read 8 bytes at
+  // once, and the high bitvector, ending in a zero past the last bucket,
+  // plus a spare word. Values are formed on the fly in one pass.
+  uint64_t num_low_words = ((uint64_t) length * low_bits + 63) / 64 + 1;
+  std::vector<uint64_t> low(num_low_words, 0);
+  uint64_t num_high_bits = length + (last_value >> low_bits) + 1;
+  uint64_t num_high_words = (num_high_bits + 63) / 64 + 1;
+  std::vector<uint64_t> high(num_high_words, 0);
+  unsigned int i = 0;
+  for (unsigned int s = 0; s < num_seeds; s++) {
+    for (; i < seed_ends[s]; i++) {
+      uint64_t value = ((uint64_t) s << position_bits) | positions[i];
+      put_bits((unsigned char*) low.data(), (uint64_t) i * low_bits, value & ((1ULL << low_bits) - 1));
+      uint64_t bit = (value >> low_bits) + i;
+      high[bit / 64] |= 1ULL << (bit % 64);
+    }
+  }
+  std::vector<uint64_t> one_samples;
+  std::vector<uint64_t> zero_samples;
+  uint64_t num_ones = 0;
+  uint64_t num_zeros = 0;
+  for (uint64_t bit = 0; bit < num_high_bits; bit++) {
+    if ((high[bit / 64] >> (bit % 64)) & 1) {
+      if (num_ones++ % EF_ONE_SAMPLE == 0) {
+        one_samples.push_back(bit);
+      }
+    } else if (num_zeros++ % EF_ZERO_SAMPLE == 0) {
+      zero_samples.push_back(bit);
+    }
+  }
+  if (one_samples.empty()) {
+    one_samples.push_back(0);
+  }
+
+  unsigned int header[8] = {length, low_bits, position_bits, (unsigned int) num_low_words,
+                            (unsigned int) num_high_words, (unsigned int) one_samples.size(),
+                            (unsigned int) zero_samples.size(), 0};
+  file.write((char *) header, sizeof(header));
+  file.write((char *) low.data(), low.size() * sizeof(uint64_t));
+  file.write((char *) high.data(), high.size() * sizeof(uint64_t));
+  file.write((char *) one_samples.data(), one_samples.size() * sizeof(uint64_t));
+  file.write((char *) zero_samples.data(), zero_samples.size() * sizeof(uint64_t));
+}
+
 int main (int argc , char** argv) {
-  if (argc < 5) {
-    std::cout << "Usage: " << argv[0] << " <Ref Seq Filename> <Seed Length (<=15)> <Interval Table Filename> <Position Table Filename> [ASCII Interval Table Filename] [ASCII Position Table Filename]" << std::endl;
+  unsigned int sample_step = 1;
+  bool packed = false;
+  bool elias_fano = false;
+  while (argc >= 2 && strncmp(argv[1], "--", 2) == 0) {
+    int num_args;
+    if (argc >= 3 && strcmp(argv[1], "--sample") == 0) {
+      char* end;
+      unsigned long step = strtoul(argv[2], &end, 10);
+      // 0 or out of range fails the check below
+      sample_step = (*end == '\0' && argv[2][0] != '-' && step <= MAX_SAMPLE_STEP) ? (unsigned int) step : 0;
+      num_args = 2;
+    } else if (strcmp(argv[1], "--packed") == 0) {
+      packed = true;
+      num_args = 1;
+    } else if (strcmp(argv[1], "--elias-fano") == 0) {
+      elias_fano = true;
+      num_args = 1;
+    } else {
+      break;
+    }
+    for (int i = 1 + num_args; i <= argc; i++) {
+      argv[i - num_args] = argv[i];
+    }
+    argc -= num_args;
+  }
+  if (argc < 5 || sample_step == 0 || (packed && elias_fano)) {
+    std::cout << "Usage: " << argv[0] << " [--sample S (1-" << MAX_SAMPLE_STEP << ")] [--packed | --elias-fano] <Ref Seq Filename> <Seed Length (<=15)> <Interval Table Filename> <Position Table Filename> [ASCII Interval Table Filename] [ASCII Position Table Filename]" << std::endl;
     exit(1);
   }
   
@@ -52,7 +204,8 @@ int main (int argc , char** argv) {
   std::ifstream ref_seq_file;
   ref_seq_file.open(argv[1]);
   ref_seq_file.read((char *)(&ref_seq_length), sizeof(unsigned int));
-  unsigned int ref_seq_bytes = (unsigned int) ceil((float) ref_seq_length / 4);
+  // Integer rounding: a float cannot hold a whole-genome length exactly
+  unsigned int ref_seq_bytes = (unsigned int) (((uint64_t) ref_seq_length + 3) / 4);
   unsigned char* ref = new unsigned char[ref_seq_bytes];
   ref_seq_file.read((char *)ref, ref_seq_bytes * sizeof(unsigned char));
   ref_seq_file.close();
@@ -68,6 +221,7 @@ int main (int argc , char** argv) {
   std::list<unsigned char> cur_seed;
   unsigned char quad;
   unsigned int char_num;
+  unsigned int cur_index = 0;
   for (unsigned int i = 0; i < ref_seq_length; i++) {
     if (i % 10000000 == 0) {
       std::cout << "Bin sizes " << i << " out of " << ref_seq_length << std::endl;
@@ -84,7 +238,10 @@ int main (int argc , char** argv) {
     }
     
     if (cur_seed.size() == seed_length) {
-      bin_sizes[seq2int(&cur_seed)]++;
+      if (cur_index % sample_step == 0) {
+        bin_sizes[seq2int(&cur_seed)]++;
+      }
+      cur_index++;
     }
   }
   
@@ -131,11 +288,11 @@ int main (int argc , char** argv) {
   
   // Compute position table
   std::cout << "Computing position table" << std::endl;
-  unsigned int position_table_length = ref_seq_length - seed_length + 1;
+  unsigned int position_table_length = (ref_seq_length - seed_length) / sample_step + 1;
   unsigned int* position_table = new unsigned int[position_table_length];
   unsigned int* position_cntrs = interval_table;
   cur_seed.clear();
-  unsigned int cur_index = 0;
+  cur_index = 0;
   for (unsigned int i = 0; i < ref_seq_length; i++) {
     if (i % 10000000 == 0) {
       std::cout << "Position table " << i << " out of " << ref_seq_length << std::endl;
@@ -152,43 +309,59 @@ int main (int argc , char** argv) {
     }
     
     if (cur_seed.size() == seed_length) {
-      unsigned int cur_seed_int = seq2int(&cur_seed);
-      
-      unsigned int cnt = position_cntrs[cur_seed_int];
-      position_table[cnt] = cur_index;
+      if (cur_index % sample_step == 0) {
+        unsigned int cur_seed_int = seq2int(&cur_seed);
+
+        unsigned int cnt = position_cntrs[cur_seed_int];
+        position_table[cnt] = cur_index;
 
+        position_cntrs[cur_seed_int]++;
+      }
       cur_index++;
-      position_cntrs[cur_seed_int]++;
-      
     }
   }
 
   // Write position table
   std::cout << "Writing position table" << std::endl;
   std::ofstream position_table_file(argv[4]);
+  unsigned int seed_length_word = seed_length;
+  if (sample_step > 1) {
+    seed_length_word |= sample_step << STEP_SHIFT;
+  }
   position_table_file.write((char *)(&ref_seq_length), sizeof(unsigned int));
-  position_table_file.write((char *)(&seed_length), sizeof(unsigned int));
-  position_table_file.write((char *)position_table, position_table_length * sizeof(unsigned int));
+  unsigned int bits = 1;
+  while (bits < 32 && ((ref_seq_length - seed_length) >> bits) != 0) {
+    bits++;
+  }
+  if (elias_fano) {
+    seed_length_word |= ELIAS_FANO_FLAG;
+    position_table_file.write((char *)(&seed_length_word), sizeof(unsigned int));
+    write_elias_fano(position_table_file, position_table, position_table_length, position_cntrs, num_seeds, bits);
+  } else if (packed) {
+    std::cout << "Packing positions at " << bits << " bits" << std::endl;
+    unsigned char* packed_table;
+    size_t packed_bytes = pack_positions(position_table, position_table_length, bits, &packed_table);
+    seed_length_word |= PACKED_FLAG;
+    position_table_file.write((char *)(&seed_length_word), sizeof(unsigned int));
+    position_table_file.write((char *)(&bits), sizeof(unsigned int));
+    position_table_file.write((char *)packed_table, packed_bytes);
+    delete[] packed_table;
+  } else {
+    position_table_file.write((char *)(&seed_length_word), sizeof(unsigned int));
+    position_table_file.write((char *)position_table, position_table_length * sizeof(unsigned int));
+  }
   position_table_file.close();
   
-  // Translate position table to ASCII
+  // Translate position table to ASCII, from memory since the file may be
+  // packed
   if (argc >= 7) {
     std::cout << "Writing ASCII position table" << std::endl;
-    std::ifstream position_table_file_read(argv[4]);
     std::ofstream position_table_ascii_file(argv[6]);
-    
-    position_table_file_read.read((char *)(&ref_seq_length), sizeof(unsigned int));
     position_table_ascii_file << ref_seq_length << std::endl;
-    
-    position_table_file_read.read((char *)(&seed_length), sizeof(unsigned int));
     position_table_ascii_file << seed_length << std::endl;
-    
-    unsigned int val;
     for (int i = 0; i < position_table_length; i++) {
-      position_table_file_read.read((char *)(&val), sizeof(unsigned int));
-      position_table_ascii_file << val << ' ';
+      position_table_ascii_file << position_table[i] << ' ';
     }
-    position_table_file_read.close();
     position_table_ascii_file.close();
   }
 }
\ No newline at end of file
@@ -0,0 +1,161 @@
+/* Joins several reference sequence files, one per contig (chromosome), into
+ * one reference sequence file that gen_tables indexes as usual, and writes
+ * the contig table the baseline's --contigs option uses to turn hit
+ * positions in the joined reference back into (contig, offset) pairs. A
+ * whole genome is then aligned against one loaded index instead of one job
+ * per chromosome.
+ *
+ * Contigs are packed back to back in the order given. Each one is named by
+ * an optional "name=" prefix on its argument, or else by its filename
+ * without directory and extension. Contig table format:
+ *   Number of contigs (4 bytes)
+ *   Per contig: start in the joined reference (4 bytes), length (4 bytes),
+ *               name length (4 bytes), name (not NUL terminated)
+ * Names longer than MAX_CONTIG_NAME characters are rejected.
+ *
+ * NOTE: Positions are 32-bit, so the joined reference holds at most
+ *       2^32 - 1 nucleotides (one 4 Gbp segment, enough for a human
+ *       genome). Seeds that span the junction of two contigs are indexed
+ *       like any other; the baseline drops hits that run off their contig.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
+#include <algorithm>
+#include <cstring>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "../baseline/exact/contigs.h"
+
+// Bytes of 2-bit sequence read or written at a time
+#define BLOCK_BYTES (1 << 20)
+
+/* Returns the contig name of a command line argument: the text before '='
+ * if there is one, otherwise the filename without directory and extension.
+ */
+std::string contig_name(const char* arg, const char** filename) {
+  const char* equals = strchr(arg, '=');
+  if (equals != NULL) {
+    *filename = equals + 1;
+    return std::string(arg, equals - arg);
+  }
+  *filename = arg;
+  std::string name(arg);
+  size_t slash = name.find_last_of('/');
+  if (slash != std::string::npos) {
+    name = name.substr(slash + 1);
+  }
+  size_t dot = name.find_last_of('.');
+  if (dot != std::string::npos && dot > 0) {
+    name = name.substr(0, dot);
+  }
+  return name;
+}
+
+int main (int argc, char** argv) {
+  if (argc < 4) {
+    std::cout << "Usage: " << argv[0] << " <Joined Ref Seq Filename> <Contig Table Filename> [name=]<Ref Seq Filename>..." << std::endl;
+    exit(1);
+  }
+
+  // Read every contig's length and name first, so that nothing is written
+  // for a set of contigs that cannot be joined
+  unsigned int num_contigs = argc - 3;
+  std::vector<std::string> names(num_contigs);
+  std::vector<const char*> filenames(num_contigs);
+  std::vector<unsigned int> starts(num_contigs);
+  std::vector<unsigned int> lengths(num_contigs);
+  uint64_t joined_length = 0;
+  for (unsigned int c = 0; c < num_contigs; c++) {
+    names[c] = contig_name(argv[3 + c], &filenames[c]);
+    if (names[c].size() > MAX_CONTIG_NAME) {
+      std::cout << "Contig name " << names[c].substr(0, 32) << "... is longer than " << MAX_CONTIG_NAME
+                << " characters" << std::endl;
+      exit(1);
+    }
+    std::ifstream ref_seq_file(filenames[c], std::ios::binary);
+    if (!ref_seq_file.is_open()) {
+      std::cout << "Could not open " << filenames[c] << std::endl;
+      exit(1);
+    }
+    ref_seq_file.read((char *)(&lengths[c]), sizeof(unsigned int));
+    if (!ref_seq_file) {
+      std::cout << "Truncated reference sequence " << filenames[c] << std::endl;
+      exit(1);
+    }
+    ref_seq_file.close();
+    starts[c] = (unsigned int) joined_length;
+    joined_length += lengths[c];
+    if (joined_length > UINT32_MAX) {
+      std::cout << "Joined reference exceeds " << UINT32_MAX << " nucleotides at contig " << names[c]
+                << "; split the contigs over several joined references" << std::endl;
+      exit(1);
+    }
+    std::cout << "Contig " << names[c] << ": " << lengths[c] << " nucleotides at " << starts[c] << std::endl;
+  }
+
+  // Write the joined reference, streaming each contig through a block at a
+  // time and shifting it into place nucleotide by nucleotide, since contigs
+  // need not end on a byte boundary. Only two blocks are held in memory.
+  std::cout << "Writing joined reference of " << joined_length << " nucleotides" << std::endl;
+  std::ofstream joined_file(argv[1], std::ios::binary);
+  if (!joined_file.is_open()) {
+    std::cout << "Could not open " << argv[1] << std::endl;
+    exit(1);
+  }
+  unsigned int ref_seq_length = (unsigned int) joined_length;
+  joined_file.write((char *)(&ref_seq_length), sizeof(unsigned int));
+  std::vector<unsigned char> contig_block(BLOCK_BYTES);
+  std::vector<unsigned char> joined_block(BLOCK_BYTES);
+  size_t joined_bytes = 0;
+  unsigned char partial = 0;  // byte being filled at position out
+  uint64_t out = 0;
+  for (unsigned int c = 0; c < num_contigs; c++) {
+    std::ifstream ref_seq_file(filenames[c], std::ios::binary);
+    ref_seq_file.seekg(sizeof(unsigned int));
+    uint64_t remaining = lengths[c];
+    while (remaining > 0) {
+      uint64_t block_length = std::min(remaining, (uint64_t) BLOCK_BYTES * 4);
+      ref_seq_file.read((char *) contig_block.data(), (block_length + 3) / 4);
+      if (!ref_seq_file) {
+        std::cout << "Truncated reference sequence " << filenames[c] << std::endl;
+        exit(1);
+      }
+      for (unsigned int i = 0; i < block_length; i++, out++) {
+        unsigned char nucleotide = (contig_block[i / 4] >> (3 - i % 4) * 2) & 3;
+        partial |= nucleotide << (3 - out % 4) * 2;
+        if (out % 4 == 3) {
+          joined_block[joined_bytes++] = partial;
+          partial = 0;
+          if (joined_bytes == BLOCK_BYTES) {
+            joined_file.write((char *) joined_block.data(), joined_bytes);
+            joined_bytes = 0;
+          }
+        }
+      }
+      remaining -= block_length;
+    }
+    ref_seq_file.close();
+  }
+  if (out % 4 != 0) {
+    joined_block[joined_bytes++] = partial;
+  }
+  joined_file.write((char *) joined_block.data(), joined_bytes);
+  joined_file.close();
+
+  // Write the contig table
+  std::ofstream contig_file(argv[2], std::ios::binary);
+  contig_file.write((char *)(&num_contigs), sizeof(unsigned int));
+  for (unsigned int c = 0; c < num_contigs; c++) {
+    unsigned int name_length = (unsigned int) names[c].size();
+    contig_file.write((char *)(&starts[c]), sizeof(unsigned int));
+    contig_file.write((char *)(&lengths[c]), sizeof(unsigned int));
+    contig_file.write((char *)(&name_length), sizeof(unsigned int));
+    contig_file.write(names[c].data(), name_length);
+  }
+  contig_file.close();
+
+  return 0;
+}